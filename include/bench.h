@@ -0,0 +1,15 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        bench.h
+//      Environment: Tiny OS
+//      Description: Contains the prototype for the in-kernel microbenchmark suite (see bench.c).
+//                   Built and run when the kernel is compiled with -DBENCH (make bench).
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_BENCH_H
+#define TINY_OS_BENCH_H
+
+void bench_run(void);
+
+#endif //TINY_OS_BENCH_H
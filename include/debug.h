@@ -20,8 +20,45 @@ void kernel_panic(const char* file, int line, const char* function, const char*
         panic("assertion %s failed.", #x);      \
     }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// LOG LEVELS                                                                                                         //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Logging statements are filtered at *compile time*: any statement below LOG_LEVEL compiles
+// to nothing — the format string isn't in the image and the arguments are never evaluated.
+// So it's fine to leave debug() statements in hot paths; a production image doesn't pay
+// for them.
+//
+// The threshold is build-configured, e.g.
+//      make build C_FLAGS="$(C_FLAGS) -DLOG_LEVEL=0"
+// for a chatty debug image. The default image elides debug() and keeps info()/warn().
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define LOG_LEVEL_DEBUG     0
+#define LOG_LEVEL_INFO      1
+#define LOG_LEVEL_WARN      2
+#define LOG_LEVEL_NONE      3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL           LOG_LEVEL_INFO
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define debug(format, ...) printf("\x1b[0;35m[DEBUG]\x1b[0m " format, ##__VA_ARGS__)
+#else
+#define debug(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
 #define info(format, ...) printf("\x1b[0;36m[INFO]\x1b[0m " format, ##__VA_ARGS__)
+#else
+#define info(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
 #define warn(format, ...) printf("\x1b[0;33m[WARN]\x1b[0m " format, ##__VA_ARGS__)
+#else
+#define warn(...) ((void)0)
+#endif
 
 #define NOT_REACHABLE   panic("executed an unreachable statement")
 #define UNUSED          __attribute__((unused))
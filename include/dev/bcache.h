@@ -0,0 +1,41 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/9/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        bcache.h
+//      Environment: Tiny OS
+//      Description: Contains the prototypes for the block buffer cache: a hash-indexed,
+//                   LRU-evicted cache of sector buffers sitting above the virtio-blk driver.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_BCACHE_H
+#define TINY_OS_BCACHE_H
+
+#include <lib/stdint.h>
+#include <lib/stdbool.h>
+#include <lib/list.h>
+
+#include <threads/synch.h>
+
+// A cached sector buffer. Callers receive the buffer *locked* and referenced from
+// bcache_read; they must hand it back with bcache_release.
+typedef struct {
+    uint64_t sector;
+    bool valid;         // does [data] hold the sector's contents?
+    uint32_t refcount;
+
+    // Guards [data]; a thread that wants a busy buffer sleeps here.
+    lock_t lock;
+
+    uint8_t* data;      // BLK_SECTOR_SIZE bytes.
+
+    list_node_t hash_node;  // position in it's hash bucket
+    list_node_t lru_node;   // position in the lru list (refcount == 0 only)
+} buf_t;
+
+void bcache_init(void);
+
+buf_t* bcache_read(uint64_t sector);
+void bcache_write(buf_t* b);
+void bcache_release(buf_t* b);
+
+#endif //TINY_OS_BCACHE_H
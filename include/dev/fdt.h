@@ -0,0 +1,21 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        fdt.h
+//      Environment: Tiny OS
+//      Description: Contains the prototypes for the flattened device tree (FDT) parser, used to
+//                   discover the machine's actual memory size at boot.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_FDT_H
+#define TINY_OS_FDT_H
+
+#include <lib/stdint.h>
+
+// The physical address of the device tree blob, passed by QEMU in a1 at reset and
+// stashed by boot.S. Zero if the platform didn't provide one.
+extern uint64_t fdt_pointer;
+
+uint64_t fdt_memory_end(void);
+
+#endif //TINY_OS_FDT_H
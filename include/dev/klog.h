@@ -0,0 +1,22 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/2/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        klog.h
+//      Environment: Tiny OS
+//      Description: Contains the prototypes for the kernel log (klog) subsystem: klog_init,
+//                   klog_flusher_init, klog_putc and klog_panic.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_KLOG_H
+#define TINY_OS_KLOG_H
+
+#include <lib/ctype.h>
+
+void klog_init(void);
+void klog_flusher_init(void);
+
+void klog_putc(uchar_t c);
+
+void klog_panic(void);
+
+#endif //TINY_OS_KLOG_H
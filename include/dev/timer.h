@@ -18,7 +18,13 @@ void timer_vm_init();
 
 uint64_t timer_ticks();
 uint64_t timer_elapsed(uint64_t then);
+
+// The kernel clock: cheap, monotonic, nanosecond-unit time (see the KERNEL CLOCK
+// section in timer.c).
+uint64_t time_ns(void);
+void timer_clock_calibrate(uint64_t freq);
 void timer_sleep(uint64_t ticks);
+void timer_rearm(void);
 
 void timer_handle_interrupt(UNUSED trap_frame_t* tf);
 
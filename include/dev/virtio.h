@@ -0,0 +1,56 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/8/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        virtio.h
+//      Environment: Tiny OS
+//      Description: Contains the prototypes for the virtio-blk driver: virtqueue setup over the
+//                   MMIO transport and a batched submission API (many requests, one notify).
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_VIRTIO_H
+#define TINY_OS_VIRTIO_H
+
+#include <lib/stdint.h>
+#include <lib/stdbool.h>
+
+#include <trap/trap.h>
+
+#include <threads/synch.h>
+
+#define BLK_SECTOR_SIZE     (512)
+
+// A block request. The caller fills [sector], [data] and [write]; the driver fills
+// [status] (zero on success) and ups [done] when the device completes the request.
+typedef struct {
+    uint64_t sector;
+    uint8_t* data;      // BLK_SECTOR_SIZE bytes, read or written by the device.
+    bool write;
+
+    uint8_t status;
+    semaphore_t done;
+
+    // The virtio request header (type/reserved/sector), referenced by the
+    // descriptor ring while the request is in flight.
+    struct {
+        uint32_t type;
+        uint32_t reserved;
+        uint64_t sector;
+    } hdr;
+} virtio_blk_req_t;
+
+void virtio_blk_init(void);
+void virtio_blk_vm_init(void);
+
+// Batched submission: stage any number of requests with virtio_blk_submit, then ring
+// the doorbell *once* with virtio_blk_kick. virtio_blk_rw is the synchronous
+// one-request convenience wrapper.
+void virtio_blk_submit(virtio_blk_req_t* req);
+void virtio_blk_kick(void);
+void virtio_blk_wait(virtio_blk_req_t* req);
+void virtio_blk_rw(virtio_blk_req_t* req);
+
+bool virtio_blk_present(void);
+
+void virtio_blk_handle_interrupt(UNUSED trap_frame_t* tf);
+
+#endif //TINY_OS_VIRTIO_H
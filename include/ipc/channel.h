@@ -0,0 +1,51 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        channel.h
+//      Environment: Tiny OS
+//      Description: Contains the types and prototypes for zero-copy IPC channels: page-granular
+//                   message passing between processes by remapping, not copying.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_CHANNEL_H
+#define TINY_OS_CHANNEL_H
+
+#include <lib/stdint.h>
+
+#include <mm/vmm.h>
+#include <threads/synch.h>
+
+// The maximum number of pages per message and the number of in-flight messages a
+// channel buffers before senders block.
+#define CHANNEL_MSG_PAGES_MAX   (8)
+#define CHANNEL_RING_SIZE       (16)
+
+// An in-flight message: the donated (or shared) page frames, the permissions the
+// receiver will map them with, and the payload length in bytes.
+typedef struct {
+    paddr_t pages[CHANNEL_MSG_PAGES_MAX];
+    size_t npages;
+    size_t length;
+    uint32_t perm;
+} channel_msg_t;
+
+typedef struct {
+    lock_t lock;
+    cond_t can_send;
+    cond_t can_recv;
+
+    // A fifo ring of in-flight messages.
+    channel_msg_t ring[CHANNEL_RING_SIZE];
+    size_t head;
+    size_t tail;
+    size_t count;
+} channel_t;
+
+void channel_init(channel_t* ch);
+
+void channel_send(channel_t* ch, vaddr_t vaddr, size_t length);
+void channel_send_shared(channel_t* ch, vaddr_t vaddr, size_t length);
+
+size_t channel_recv(channel_t* ch, vaddr_t vaddr);
+
+#endif //TINY_OS_CHANNEL_H
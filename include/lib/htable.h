@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/12/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        htable.h
+//      Environment: Tiny OS
+//      Description: An intrusive chained hash table in the style of list.h: the node is embedded
+//                   in the owning struct and recovered with a container-of macro. Keys are
+//                   uint64_t; the caller supplies the hash function and a key extractor. The
+//                   bucket array starts small (embedded in the table) and grows via the page
+//                   allocator, so early-boot use needs no allocation at all.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_HTABLE_H
+#define TINY_OS_HTABLE_H
+
+#include <lib/stddef.h>
+#include <lib/stdint.h>
+
+
+typedef struct htable_node {
+    struct htable_node* next;
+} htable_node_t;
+
+// Extracts the node's key (e.g. the owning thread's tid).
+typedef uint64_t (*htable_key_t)(htable_node_t* x);
+
+// Hashes a key. The table masks the hash down to a bucket index (the bucket count
+// is always a power of two), so the hash should spread nearby keys — multiplying by
+// a large odd constant is plenty for sequential ids.
+typedef uint64_t (*htable_hash_t)(uint64_t key);
+
+// The number of buckets in the embedded initial array. Once the table outgrows it,
+// the buckets move to pages from the PMM (see __htable_grow).
+#define HTABLE_INIT_BUCKETS     (16)
+
+typedef struct {
+    htable_node_t** buckets;
+    size_t num_buckets;
+    size_t size;
+
+    // The allocation order of [buckets] once it has moved to the page allocator
+    // (meaningless while buckets still points at [static_buckets]).
+    size_t order;
+
+    htable_key_t key_of;
+    htable_hash_t hash;
+
+    htable_node_t* static_buckets[HTABLE_INIT_BUCKETS];
+} htable_t;
+
+/*
+ * Recovers the owning struct from an embedded htable node (cf. LIST_VALUE).
+ */
+#define HTABLE_VALUE(__struct, __member, htable_node)               \
+    ((__struct*)                                                    \
+        ((uint8_t*) (htable_node) - offsetof(__struct, __member))   \
+    )
+
+void htable_init(htable_t* ht, htable_key_t key_of, htable_hash_t hash);
+
+void htable_insert(htable_t* ht, htable_node_t* x);
+void htable_delete(htable_t* ht, htable_node_t* x);
+
+htable_node_t* htable_find(htable_t* ht, uint64_t key);
+
+size_t htable_size(htable_t* ht);
+
+
+#endif //TINY_OS_HTABLE_H
@@ -0,0 +1,40 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/5/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        mpsc.h
+//      Environment: Tiny OS
+//      Description: A lock-free multi-producer single-consumer intrusive queue, for handing
+//                   work from interrupt handlers to service threads without either side
+//                   holding a lock over the structure.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_MPSC_H
+#define TINY_OS_MPSC_H
+
+#include <lib/stddef.h>
+#include <lib/stdbool.h>
+
+typedef struct mpsc_node {
+    struct mpsc_node* next;
+} mpsc_node_t;
+
+// Producers push onto [head] with a compare-and-swap loop, building a lifo chain; the
+// single consumer detaches the entire chain with one atomic exchange and reverses it,
+// yielding the nodes in fifo order. Neither side ever waits on the other, so producers
+// may run in interrupt context (on any hart) while the consumer runs in a thread.
+typedef struct {
+    mpsc_node_t* volatile head;
+} mpsc_queue_t;
+
+#define MPSC_VALUE(__struct, __member, mpsc_node)                   \
+    ((__struct*)                                                    \
+        ((uint8_t*) (mpsc_node) - offsetof(__struct, __member))     \
+    )
+
+void mpsc_init(mpsc_queue_t* queue);
+bool mpsc_empty(mpsc_queue_t* queue);
+
+bool mpsc_push(mpsc_queue_t* queue, mpsc_node_t* node);
+mpsc_node_t* mpsc_drain(mpsc_queue_t* queue);
+
+#endif //TINY_OS_MPSC_H
@@ -0,0 +1,65 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/10/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        pheap.h
+//      Environment: Tiny OS
+//      Description: An intrusive pairing heap (a mergeable min-heap) in the style of list.h:
+//                   the node is embedded in the owning struct and recovered with a
+//                   container-of macro. Insert and merge are O(1); extract-min and delete
+//                   are amortized O(log n).
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_PHEAP_H
+#define TINY_OS_PHEAP_H
+
+#include <lib/stddef.h>
+#include <lib/stdbool.h>
+
+
+/*
+ * A pairing heap is a multi-way tree with the min at the root. Each node points to
+ * it's leftmost [child] and it's right [sibling]; [prev] points to the left sibling,
+ * or to the parent for a leftmost child — which is what makes deleting an interior
+ * node O(1) unlinking (plus the merge of it's children).
+ */
+typedef struct pheap_node {
+    struct pheap_node* child;
+    struct pheap_node* sibling;
+    struct pheap_node* prev;
+} pheap_node_t;
+
+/*
+ * The heap's ordering: returns whether [a] orders strictly before [b]. The heap
+ * only ever compares, so ties are broken arbitrarily (i.e. the heap is not stable).
+ */
+typedef bool (*pheap_less_t)(pheap_node_t* a, pheap_node_t* b);
+
+typedef struct {
+    pheap_node_t* root;
+    size_t size;
+    pheap_less_t less;
+} pheap_t;
+
+/*
+ * Recovers the owning struct from an embedded pheap node (cf. LIST_VALUE).
+ */
+#define PHEAP_VALUE(__struct, __member, pheap_node)                 \
+    ((__struct*)                                                    \
+        ((uint8_t*) (pheap_node) - offsetof(__struct, __member))    \
+    )
+
+void pheap_init(pheap_t* heap, pheap_less_t less);
+
+void pheap_push(pheap_t* heap, pheap_node_t* x);
+
+pheap_node_t* pheap_peek(pheap_t* heap);
+pheap_node_t* pheap_pop(pheap_t* heap);
+
+void pheap_delete(pheap_t* heap, pheap_node_t* x);
+
+void pheap_merge(pheap_t* heap, pheap_t* other);
+
+size_t pheap_size(pheap_t* heap);
+
+
+#endif //TINY_OS_PHEAP_H
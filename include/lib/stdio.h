@@ -28,9 +28,13 @@ int snprintf(char* buffer, size_t n, const char* format, ...);
 int vprintf(const char* format, va_list va);
 int vsnprintf(char* buffer, size_t n, const char* format, va_list va);
 
-// Internal implementations (yikes, plz don't use unless you know what you're doing)
-void __printf(const char* format, void (*putc)(char, void*), void* buf, ...);
-void __vprintf(const char* format, va_list va, void (*putc)(char, void*), void* buf);
+// Internal implementations (yikes, plz don't use unless you know what you're doing).
+// The sink is a *block* write — __vprintf emits literal runs and converted numbers
+// in one call each, so sinks can amortize their per-write costs (memcpy for the
+// string buffer, one lock round trip for the klog ring) instead of paying them
+// per character.
+void __printf(const char* format, void (*putn)(const char* s, size_t n, void* buf), void* buf, ...);
+void __vprintf(const char* format, va_list va, void (*putn)(const char* s, size_t n, void* buf), void* buf);
 
 
 
@@ -0,0 +1,44 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/16/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        arena.h
+//      Environment: Tiny OS
+//      Description: An arena (bump) allocator for transient allocations: many arena_allocs, one
+//                   arena_destroy. Allocation is a pointer bump — no per-allocation bookkeeping,
+//                   no locking, no fragmentation of the malloc buckets — and destruction hands
+//                   the arena's pages back to the PMM in one motion.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_ARENA_H
+#define TINY_OS_ARENA_H
+
+#include <lib/stddef.h>
+#include <lib/stdint.h>
+
+/*
+ * The chunks (page-allocator blocks) backing the arena, chained newest-first so
+ * arena_destroy can walk and free them. The arena_t itself lives inside the first
+ * chunk, so an arena costs exactly it's chunks.
+ */
+typedef struct arena_chunk {
+    struct arena_chunk* next;
+    size_t order;
+} arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t* chunks;
+
+    // The bump region of the current (newest) chunk.
+    uint8_t* pos;
+    uint8_t* end;
+} arena_t;
+
+// Everything returned by arena_alloc is aligned to this (matching the malloc
+// buckets' minimum block size).
+#define ARENA_ALIGN     (16)
+
+arena_t* arena_create(void);
+void* arena_alloc(arena_t* arena, size_t size);
+void arena_destroy(arena_t* arena);
+
+#endif //TINY_OS_ARENA_H
@@ -14,11 +14,27 @@
 #define PAGE_ROUND_UP(p)    (ROUND_UP((p), PAGE_SIZE))
 #define PAGE_OFFSET(p)      ((p) - PAGE_ROUND_DOWN(p))
 
+// The managed range is partitioned into zones, each an independent buddy allocator
+// (see the MEMORY ZONES section in pmm.c): ZONE_DMA is a small, low, contiguity-
+// preserving region for device buffers; ZONE_NORMAL is everything else.
+#define ZONE_DMA            (0)
+#define ZONE_NORMAL         (1)
+#define NUM_ZONE            (2)
+
 void pmm_init();
+void pmm_scrubber_init();
 
+void* alloc_pages_zone(size_t zone, size_t order);
 void* alloc_pages(size_t order);
+void* alloc_page_zeroed();
 void free_pages(void* ptr, size_t order);
 
+// Per-frame reference counts for copy-on-write sharing (see pagetable_clone in
+// vmm.c). A frame's count records it's *additional* owners; free_pages only
+// returns a frame to the allocator once the count has dropped to zero.
+void page_ref_inc(void* ptr);
+size_t page_ref_dec(void* ptr);
+
 static inline size_t page_order(size_t size) {
     size_t order;
     size = (size - 1) >> PAGE_SHIFT;
@@ -29,7 +45,8 @@ static inline size_t page_order(size_t size) {
 }
 
 // Define some useful macros.
-#define alloc_page()    alloc_pages(0)
-#define free_page(ptr)  free_pages(ptr, 0)
+#define alloc_page()        alloc_pages(0)
+#define alloc_page_dma()    alloc_pages_zone(ZONE_DMA, 0)
+#define free_page(ptr)      free_pages(ptr, 0)
 
 #endif //TINY_OS_MM_H
@@ -0,0 +1,22 @@
+//
+// Created by Alistair O'Brien on 10/6/2020.
+//
+
+#ifndef TINY_OS_SLAB_H
+#define TINY_OS_SLAB_H
+
+#include <lib/stddef.h>
+#include <lib/stdint.h>
+
+// A slab cache hands out fixed-size objects of a single type. See slab.c for the
+// design notes. The slab_cache struct itself is internal to slab.c.
+typedef struct slab_cache slab_cache_t;
+
+void slab_init(void);
+
+slab_cache_t* slab_cache_create(const char* name, size_t object_size, void (*ctor)(void* object));
+
+void* slab_alloc(slab_cache_t* cache);
+void slab_free(void* object);
+
+#endif //TINY_OS_SLAB_H
@@ -6,6 +6,7 @@
 #define TINY_OS_VMM_H
 
 #include <lib/stdint.h>
+#include <lib/stdbool.h>
 
 // Page Table Entry (PTE) Macros
 
@@ -19,6 +20,12 @@ typedef uint64_t    vaddr_t;
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4)
 
+// A software bit (RSW, bits 8-9 are reserved for the supervisor's use): marks a
+// page shared copy-on-write. Such a pte has PTE_W clear; the write bit is restored
+// at fault time once the faulting process owns a private copy (see
+// uvm_handle_cow_fault).
+#define PTE_COW (1L << 8)
+
 #define PTE_MODE_MASK (0xe) // Read, write and execute bits
 
 #define PTE_SHIFT 10
@@ -42,6 +49,16 @@ typedef uint64_t    vaddr_t;
 #define VPN_SHIFT(level) (OFFSET_SHIFT + (9 * (level)))
 #define VPN(vaddr, level) ((((vaddr_t)vaddr) >> VPN_SHIFT(level)) & VPN_MASK)
 
+// Sv39 permits leaf PTEs at the upper levels of the walk: a leaf at level 1 maps a
+// 2MB megapage and a leaf at level 2 maps a 1GB gigapage.
+#define LEVEL_SIZE(level) (1L << VPN_SHIFT(level))
+
+#define MEGAPAGE_SIZE   (LEVEL_SIZE(1))
+#define MEGAPAGE_ORDER  (9) // MEGAPAGE_SIZE = 2^MEGAPAGE_ORDER * PAGE_SIZE
+
+// A pte is a leaf iff any of it's read, write or execute bits are set.
+#define PTE_IS_LEAF(pte) (((pte) & PTE_MODE_MASK) != 0)
+
 // Physical Address Macros
 
 // define a physical address as PNN2 | PPN1 | PPN0 | page offset
@@ -62,6 +79,20 @@ typedef uint64_t    vaddr_t;
 // Hence 38 bits instead of 39.
 #define MAX_VADDR (1L << 38)
 
+// The user virtual address layout. User mappings live in the second gigabyte, which
+// gives them a top-level page table slot of their own: the kernel's identity map uses
+// slot 0 (the devices) and slot 2 onwards (RAM from 0x80000000), so sharing the
+// kernel's top-level entries (see uvm_create) never collides with user mappings.
+#define USER_TEXT_START (0x40000000L)
+#define USER_STACK_TOP  (0x50000000L)
+
+// The user stack is a virtual range of USER_STACK_PAGES pages below USER_STACK_TOP.
+// Only the top page is materialized at process creation; the rest appear on demand
+// in the page-fault path (see uvm_handle_stack_fault). The lowest page of the range
+// is a guard page that is *never* materialized, so runaway recursion faults cleanly
+// instead of silently running into whatever is mapped below.
+#define USER_STACK_PAGES (8)
+
 // 512 entries (essentially pte_t[512])
 typedef pte_t* pagetable_t;
 
@@ -76,5 +107,13 @@ pagetable_t kpagetable(void);
 void kmap(vaddr_t vaddr, paddr_t paddr, size_t length, uint32_t perm);
 void kunmap(vaddr_t vaddr, size_t length);
 
+pagetable_t uvm_create(void);
+void uvm_destroy(pagetable_t table);
+
+pagetable_t pagetable_clone(pagetable_t src);
+bool uvm_handle_cow_fault(vaddr_t vaddr);
+bool uvm_handle_stack_fault(vaddr_t vaddr);
+void uvm_write_protect(pagetable_t table, vaddr_t vaddr);
+
 
 #endif //TINY_OS_VMM_H
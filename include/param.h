@@ -5,7 +5,9 @@
 #ifndef TINY_OS_PARAM_H
 #define TINY_OS_PARAM_H
 
-#define NUM_HART                (1)
+// The number of harts (hardware threads) the kernel is built for.
+// Note: this must be kept in sync with the -smp option in build/Makefile.
+#define NUM_HART                (4)
 #define TIMER_INTERVAL          (1000000)
 
 #endif //TINY_OS_PARAM_H
@@ -0,0 +1,44 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        perf.h
+//      Environment: Tiny OS
+//      Description: Contains the per-hart performance counter registry: named event counters
+//                   updated with plain per-hart increments, dumpable on demand.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_PERF_H
+#define TINY_OS_PERF_H
+
+#include <lib/stdint.h>
+
+#include <param.h>
+#include <riscv.h>
+
+// The counted events. Keep in sync with the name table in perf.c.
+typedef enum {
+    PERF_CTX_SWITCH,        // context switches (schedule dispatched a new thread)
+    PERF_TRAP_INTERRUPT,    // traps taken for interrupts
+    PERF_TRAP_EXCEPTION,    // traps taken for exceptions
+    PERF_SYSCALL,           // fast-path syscalls dispatched
+    PERF_PAGE_ALLOC,        // pages handed out by the PMM
+    PERF_PAGE_FREE,         // pages returned to the PMM
+    PERF_LOCK_CONTENTION,   // spinlock acquisitions that had to wait for a ticket
+    PERF_COW_FAULT,         // copy-on-write faults resolved
+    PERF_STACK_FAULT,       // user stack pages materialized on demand
+    PERF_MAX
+} perf_event_t;
+
+extern uint64_t perf_counters[NUM_HART][PERF_MAX];
+
+// The increment is deliberately bare: a hart-local add with no atomics and no
+// locking. An interrupt landing between the load and the store can lose a count —
+// these are statistics, not ledgers, and the hot paths they sit on (every trap,
+// every page allocation) can't afford more.
+static inline void perf_count(perf_event_t event) {
+    perf_counters[r_hartid()][event]++;
+}
+
+void perf_dump(void);
+
+#endif //TINY_OS_PERF_H
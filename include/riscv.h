@@ -177,6 +177,55 @@ static inline void w_mideleg(uint64_t x) {
     asm ("csrw mideleg, %0" : : "r" (x));
 }
 
+/***********************************************************************************************************************
+ * The mcounteren register controls which of the hardware performance counters
+ * (cycle, time, instret) are readable from supervisor mode. Each counter has it's
+ * own enable bit; reads of a counter whose bit is clear raise an illegal
+ * instruction exception.
+ *
+ */
+
+#define MCOUNTEREN_CY (1L << 0)
+#define MCOUNTEREN_TM (1L << 1)
+#define MCOUNTEREN_IR (1L << 2)
+
+static inline uint64_t r_mcounteren() {
+    uint64_t x;
+    asm ("csrr %0, mcounteren" : "=r" (x));
+    return x;
+}
+
+static inline void w_mcounteren(uint64_t x) {
+    asm ("csrw mcounteren, %0" : : "r" (x));
+}
+
+/***********************************************************************************************************************
+ * The hardware performance counters: cycle counts the hart's clock cycles, instret
+ * the instructions it has retired and time mirrors the CLINT's mtime. All three are
+ * read-only from supervisor mode (once enabled in mcounteren, see init in main.c)
+ * and are the kernel's finest-grained view of where time actually goes — compare
+ * timer_ticks(), which advances at interrupt granularity.
+ *
+ */
+
+static inline uint64_t r_cycle() {
+    uint64_t x;
+    asm volatile ("rdcycle %0" : "=r" (x));
+    return x;
+}
+
+static inline uint64_t r_time() {
+    uint64_t x;
+    asm volatile ("rdtime %0" : "=r" (x));
+    return x;
+}
+
+static inline uint64_t r_instret() {
+    uint64_t x;
+    asm volatile ("rdinstret %0" : "=r" (x));
+    return x;
+}
+
 /***********************************************************************************************************************
  * The mip register is a 64-bit read/write register containing details about pending interrupts.
  *
@@ -453,6 +502,16 @@ static inline void w_mtval(uint64_t x) {
  * The sstatus register offers a restricted view of the mstatus register. See mstatus (line 35).
  */
 
+// FS (floating-point state) field: tracks the status of the F/D register file.
+// Off causes every FP instruction to raise an illegal-instruction exception; the
+// hardware bumps Clean -> Dirty on the first FP write (see the lazy FPU switching
+// in thread.c).
+#define SSTATUS_FS_MASK     (3L << 13)
+#define SSTATUS_FS_OFF      (0L << 13)
+#define SSTATUS_FS_INITIAL  (1L << 13)
+#define SSTATUS_FS_CLEAN    (2L << 13)
+#define SSTATUS_FS_DIRTY    (3L << 13)
+
 #define SSTATUS_SPP_MASK    (1L << 8)
 #define SSTATUS_SPP_S       (1L << 8)
 #define SSTATUS_SPP_U       (0L << 8)
@@ -497,6 +556,26 @@ static inline void w_sepc(uint64_t x) {
 }
 
 
+/***********************************************************************************************************************
+ * The sscratch is a 64-bit read/write register for the supervisor's own use.
+ *
+ * Tiny OS uses it to distinguish traps from user mode from traps from the kernel:
+ * it holds the current thread's kernel stack top while executing in user mode and
+ * zero while executing in the kernel (see s_trap_vec in trap_vec.S).
+ *
+ */
+
+static inline uint64_t r_sscratch() {
+    uint64_t x;
+    asm ("csrr %0, sscratch" : "=r" (x));
+    return x;
+}
+
+static inline void w_sscratch(uint64_t x) {
+    asm ("csrw sscratch, %0" : : "r" (x));
+}
+
+
 /***********************************************************************************************************************
  * The stvec register is a 64-bit read/write register that holds the trap vector config
  * It consists of a base address for the trap vector (BASE) and a trap vector mode (mode)
@@ -688,6 +767,23 @@ static uint64_t r_satp() {
     return x;
 }
 
+/***********************************************************************************************************************
+ * The sfence.vma instruction synchronizes updates to the page tables with the hart's address-translation
+ * caches (i.e. the TLB). The rs1 and rs2 operands refine the set of translations that are invalidated:
+ * with rs1 = x0, all translations are invalidated; with rs1 != x0, only translations for the virtual
+ * address in rs1 are invalidated. (rs2 selects an ASID; we currently always use ASID 0.)
+ */
+
+// Invalidate all address-translation caches (a full TLB flush).
+static inline void sfence_vma() {
+    asm volatile ("sfence.vma zero, zero");
+}
+
+// Invalidate the address-translation caches for the page containing [vaddr] only.
+static inline void sfence_vma_addr(uint64_t vaddr) {
+    asm volatile ("sfence.vma %0, zero" : : "r" (vaddr));
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #endif //TINY_OS_RISCV_H
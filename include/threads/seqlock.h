@@ -0,0 +1,53 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/14/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        seqlock.h
+//      Environment: Tiny OS
+//      Description: A sequence lock for read-mostly multi-word state (e.g. the kernel clock).
+//                   Readers never block, never disable interrupts and never write shared memory —
+//                   they just retry if a writer raced them — so reads stay cheap no matter how
+//                   many harts are reading.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_SEQLOCK_H
+#define TINY_OS_SEQLOCK_H
+
+#include <lib/stdint.h>
+#include <lib/stdbool.h>
+
+#include <threads/spinlock.h>
+
+/*
+ * The [sequence] is even when no write is in progress and odd while one is. A reader
+ * snapshots the sequence, reads the protected state, and retries if the sequence was
+ * odd or has changed — i.e. if a writer was (or became) active during the read.
+ * Writers serialize against each other with the embedded spinlock.
+ *
+ * The usual seqlock caveats apply: the protected state must be plain data (a reader
+ * may observe a torn write mid-retry, so no pointers that are chased before the
+ * retry check), and writers should be rare and brief.
+ */
+typedef struct {
+    volatile uint64_t sequence;
+    spinlock_t lock;
+} seqlock_t;
+
+void seqlock_init(seqlock_t* seqlock);
+
+// Readers: snapshot the sequence, read the state, then retry while a write raced.
+//
+//      uint64_t seq;
+//      do {
+//          seq = seqlock_read_begin(&lock);
+//          ... read the protected state ...
+//      } while (seqlock_read_retry(&lock, seq));
+//
+uint64_t seqlock_read_begin(seqlock_t* seqlock);
+bool seqlock_read_retry(seqlock_t* seqlock, uint64_t sequence);
+
+// Writers: serialized by the embedded spinlock (and hence run with interrupts
+// disabled, like any spinlock critical section).
+intr_state_t seqlock_write_begin(seqlock_t* seqlock);
+void seqlock_write_end(seqlock_t* seqlock, intr_state_t state);
+
+#endif //TINY_OS_SEQLOCK_H
@@ -0,0 +1,39 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/7/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        spinlock.h
+//      Environment: Tiny OS
+//      Description: A ticket spinlock for the microsecond-scale critical sections in the scheduler and the
+//                   memory managers, where the semaphore-backed lock_t (which sleeps) is unusable.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_SPINLOCK_H
+#define TINY_OS_SPINLOCK_H
+
+#include <lib/stdint.h>
+#include <lib/stdbool.h>
+
+#include <trap/interrupt.h>
+
+/*
+ * A ticket lock grants the lock in ticket order: acquirers take the next ticket with a fetch-and-add
+ * and spin until [now_serving] reaches their ticket. This makes acquisition queue-fair under
+ * contention (unlike a naive test-and-set, where one hart can win the cache line repeatedly while
+ * it's siblings starve).
+ *
+ * Acquisition composes with the interrupt state machinery: spinlock_acquire disables interrupts
+ * (spinning with interrupts enabled invites a deadlock with our own interrupt handlers) and returns
+ * the previous state, which the matching spinlock_release restores.
+ */
+typedef struct {
+    volatile uint64_t next_ticket;
+    volatile uint64_t now_serving;
+} spinlock_t;
+
+void spinlock_init(spinlock_t* spinlock);
+
+intr_state_t spinlock_acquire(spinlock_t* spinlock);
+bool spinlock_try_acquire(spinlock_t* spinlock, intr_state_t* state);
+void spinlock_release(spinlock_t* spinlock, intr_state_t state);
+
+#endif //TINY_OS_SPINLOCK_H
@@ -21,6 +21,11 @@ context_t* switch_contexts(context_t** cur, context_t** next);
 
 void __schedule_tail_entry(context_t* prev);
 
+// Dump/load the full FP register file (f0-f31 + fcsr) to/from a thread's fpu_state
+// area. sstatus.FS must be enabled by the caller.
+void fpu_save_state(uint64_t* fpu_state);
+void fpu_restore_state(uint64_t* fpu_state);
+
 #endif
 
 
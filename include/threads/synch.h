@@ -9,11 +9,35 @@
 #include <lib/stdbool.h>
 #include <lib/list.h>
 
+#include <threads/spinlock.h>
 #include <threads/thread.h>
 
+// A priority-indexed wait queue: a fifo queue per priority level with a bitmap
+// whose i-th bit is set iff queues[i] is non-empty (mirroring the scheduler's
+// per-hart ready queues). Waking the highest-priority waiter is then a
+// find-first-set plus a pop, rather than a linear scan of a single list.
+typedef struct waitq {
+    // Guards the bitmap, the queues and the waiters' status/waitq transitions.
+    // Wait queues are mutated from *remote* harts — semaphore_up may fire from any
+    // hart (even a softirq), and a priority donor requeues a blocked thread from
+    // it's own hart — so interrupts-off alone is not enough; see synch.c.
+    spinlock_t lock;
+
+    uint32_t bitmap;
+    list_t queues[NUM_PRIORITY];
+} waitq_t;
+
+void waitq_init(waitq_t* q);
+bool waitq_empty(waitq_t* q);
+uint8_t waitq_max_priority(waitq_t* q);
+
+void waitq_push(waitq_t* q, thread_t* t);
+thread_t* waitq_pop_highest(waitq_t* q);
+void waitq_requeue(waitq_t* q, thread_t* t, uint8_t priority);
+
 typedef struct {
     uint64_t value;
-    list_t waiters; // A list of threads
+    waitq_t waiters;
 } semaphore_t;
 
 void semaphore_init(semaphore_t* semaphore, uint64_t value);
@@ -22,9 +46,12 @@ bool semaphore_try_down(semaphore_t* semaphore);
 void semaphore_down(semaphore_t* semaphore);
 void semaphore_up(semaphore_t* semaphore);
 
-typedef struct {
+typedef struct lock {
     thread_t* holder;
     semaphore_t semaphore;
+
+    // Position in the holder's held_locks list (for priority donation).
+    list_node_t list_node;
 } lock_t;
 
 void lock_init(lock_t* lock);
@@ -33,4 +60,16 @@ bool lock_try_acquire(lock_t* lock);
 void lock_acquire(lock_t* lock);
 void lock_release(lock_t* lock);
 
+// A condition variable. Always used with an associated lock_t guarding the
+// condition itself.
+typedef struct {
+    waitq_t waiters;
+} cond_t;
+
+void cond_init(cond_t* cond);
+
+void cond_wait(cond_t* cond, lock_t* lock);
+void cond_signal(cond_t* cond);
+void cond_broadcast(cond_t* cond);
+
 #endif //TINY_OS_SYNC_H
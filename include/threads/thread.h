@@ -7,22 +7,104 @@
 
 #include <lib/stdint.h>
 #include <lib/list.h>
+#include <lib/pheap.h>
+#include <lib/htable.h>
 
 #include <mm/vmm.h>
 #include <trap/trap.h>
 
+#include <threads/spinlock.h>
 #include <threads/switch.h>
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// States in a thread life cycle :)
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Thread priorities. A higher value => a higher priority. New threads are created with
+// PRI_DEFAULT unless specified otherwise.
+#define PRI_MIN         (0)
+#define PRI_DEFAULT     (15)
+#define PRI_MAX         (31)
+#define NUM_PRIORITY    (32)
+
 typedef struct {
+    // The number of remaining timer ticks in this thread's time slice.
     uint64_t time;
+
+    // Runtime accounting (all stamps are rdtime/mtime cycles, which are consistent
+    // across harts — so the figures survive work stealing).
+
+    // The total time this thread has spent running, settled at every switch-out
+    // (see schedule).
+    uint64_t runtime;
+
+    // The stamp of the thread's latest dispatch (see thread_run).
+    uint64_t last_dispatched;
+
+    // The stamp of the latest scheduler_push, i.e. when the thread last became
+    // ready; zero if the thread has never been pushed (the idle threads).
+    uint64_t ready_since;
+
+    // Wakeup-to-dispatch latency: the total and worst-case time spent sitting on a
+    // ready queue, over [dispatches] dispatches.
+    uint64_t wait_total;
+    uint64_t wait_worst;
+    uint64_t dispatches;
+
+    // The effective priority the scheduler uses for queueing. The multi-level feedback
+    // scheduler demotes this when a thread burns it's entire time slice and restores it
+    // to [base_priority] when the thread blocks (i.e. behaves interactively).
+    uint8_t priority;
+
+    // The priority assigned at creation (or via thread_set_priority).
+    uint8_t base_priority;
 } scheduler_info_t;
 
+// The fixed-point shift of hart_t's loadavg: a load average of 1.0 is
+// (1 << LOADAVG_SHIFT).
+#define LOADAVG_SHIFT   (11)
+
 void scheduler_start(void);
-void scheduler_tick(void);
+void scheduler_tick(uint64_t elapsed);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct thread;
+
+typedef struct {
+    uint64_t hartid;
+
+    // The per-hart scheduler state: a fifo queue per priority level of threads with
+    // thread->status == THREAD_READY and this hart's dedicated idle thread.
+    // The [ready_bitmap] has bit i set iff ready_queues[i] is non-empty, so picking the
+    // next thread is a find-first-set plus a pop.
+    // The queues are guarded by the ticket spinlock [ready_lock], since sibling
+    // harts may steal from the queue tails when their own queues drain.
+    spinlock_t ready_lock;
+    uint32_t ready_bitmap;
+    list_t ready_queues[NUM_PRIORITY];
+    struct thread* idle_thread;
+
+    // The number of threads currently sitting on this hart's ready queues
+    // (maintained under the ready_lock).
+    uint64_t ready_count;
+
+    // A decayed (exponentially weighted) average of this hart's load — the ready
+    // queue depth plus the running thread — in LOADAVG_SHIFT fixed point, updated
+    // from scheduler_tick.
+    uint64_t loadavg;
+
+    // The thread whose state the hart's FP register file currently holds (see the
+    // lazy FPU switching in thread.c), or null.
+    struct thread* fpu_owner;
+
+    // A spinlock handed off by thread_block_release, released by __schedule_tail
+    // once the blocking thread's context is saved (or null).
+    spinlock_t* block_release;
+} hart_t;
+
+hart_t* hart_current(void);
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -50,24 +132,57 @@ typedef enum {
 
 typedef uint64_t tid_t;
 
-typedef struct {
+struct lock;
+struct waitq;
+
+typedef struct thread {
     // Thread metadata
     tid_t tid;
     char name[32];
 
-    thread_state_t status;    
+    thread_state_t status;
     proc_t* proc;
     int64_t exit_code;
 
     // Used for list processing
     list_node_t list_node;
 
+    // Links the thread onto the global thread registry (see thread_stats_foreach);
+    // [list_node] can't be reused for this, it's busy whenever the thread sits on a
+    // ready/wait queue.
+    list_node_t all_node;
+
+    // The thread's node in the global tid index (see thread_by_tid).
+    htable_node_t tid_node;
+
+    // The tick at which a sleeping thread is to be woken and the thread's node on
+    // it's hart's sleep queue, a pairing heap ordered by wakeup_tick (see timer_sleep).
+    uint64_t wakeup_tick;
+    pheap_node_t sleep_node;
+
     // Thread context
     context_t* ctx;
 
     // Scheduler info
     scheduler_info_t scheduler_info;
 
+    // The hart whose ready queue this thread sits on while THREAD_READY (needed to
+    // requeue the thread when it's priority changes, see thread_update_priority).
+    hart_t* ready_hart;
+
+    // Priority donation bookkeeping (see synch.c): the lock this thread is currently
+    // blocked on (if any) and the locks it holds.
+    struct lock* waiting_on;
+    list_t held_locks;
+
+    // The wait queue this thread is parked on while THREAD_BLOCKED (if any), so that
+    // a priority donation can move it to the right queue (see waitq_requeue).
+    struct waitq* waitq;
+
+    // The thread's saved FP register file: f0-f31 plus fcsr. Only threads that
+    // actually touch FP ever pay for saving/restoring it (lazy FPU switching).
+    uint64_t fpu_state[33];
+
     // Prevents overflows :)
     uint64_t magic;
 } thread_t;
@@ -79,8 +194,19 @@ void thread_hart_init(void);
 
 thread_t* thread_current(void);
 tid_t thread_tid(void);
+thread_t* thread_by_tid(tid_t tid);
+
+tid_t kthread_create(char* name, void (*function)(void*), void* arg);
+tid_t kthread_create_with_priority(char* name, void (*function)(void*), void* arg, uint8_t priority);
+
+tid_t uprocess_create(char* name, const void* code, size_t size);
+
+uint8_t thread_get_priority(void);
+void thread_set_priority(uint8_t priority);
+void thread_update_priority(thread_t* t, uint8_t priority);
 
 void thread_block(void);
+void thread_block_release(spinlock_t* lock);
 void thread_unblock(thread_t* t);
 
 void thread_exit(uint64_t code);
@@ -88,6 +214,13 @@ void thread_yield(void);
 
 void __schedule_tail(thread_t* prev);
 
+// Thread statistics: walk every live thread (under the registry lock), and the
+// ps-alike console dump built on top of it.
+void thread_stats_foreach(void (*fn)(thread_t* t, void* aux), void* aux);
+void thread_stats_dump(void);
+
+void fpu_handle_fault(trap_frame_t* tf);
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
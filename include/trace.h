@@ -0,0 +1,48 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/8/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        trace.h
+//      Environment: Tiny OS
+//      Description: Static tracepoints. A tracepoint is a named, cycle-stamped record written into
+//                   a per-hart ring buffer — far cheaper than a log statement (no formatting, no
+//                   uart), so they can live on the scheduler and trap paths. Tracepoints are only
+//                   compiled in with -DTRACE; the image we ship contains none.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_TRACE_H
+#define TINY_OS_TRACE_H
+
+#include <lib/stdint.h>
+
+// The number of records in each hart's ring. Must be a power of two (the head
+// counter is masked, not wrapped).
+#define TRACE_RING_SIZE     (512)
+
+/*
+ * A single tracepoint record. The [name] is a pointer to a string literal compiled
+ * into the image, so a record is three stores — the decode (mapping pointers back to
+ * names) happens offline, or lazily in trace_dump.
+ */
+typedef struct trace_record {
+    const char* name;
+    uint64_t cycles;
+    uint64_t arg;
+} trace_record_t;
+
+#ifdef TRACE
+
+void __trace(const char* name, uint64_t arg);
+void trace_dump(void);
+
+// [name] must be a string literal — we store the pointer, not the contents.
+#define trace(name, arg) __trace(name, (uint64_t)(arg))
+
+#else
+
+// Without -DTRACE, tracepoints compile to nothing (arguments unevaluated).
+#define trace(name, arg) ((void)0)
+#define trace_dump() ((void)0)
+
+#endif
+
+#endif //TINY_OS_TRACE_H
@@ -0,0 +1,31 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        softirq.h
+//      Environment: Tiny OS
+//      Description: Contains the prototypes for the softirq (bottom-half) layer: deferred
+//                   interrupt work that runs with interrupts enabled before returning
+//                   from s_trap.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_SOFTIRQ_H
+#define TINY_OS_SOFTIRQ_H
+
+#include <lib/stdint.h>
+
+// The softirq numbers. Lower numbers run first when several are pending.
+enum {
+    SOFTIRQ_UART_RX     = 0,
+    SOFTIRQ_VIRTIO_BLK  = 1,
+
+    SOFTIRQ_MAX         = 8
+};
+
+typedef void (*softirq_handler_t)(void);
+
+void softirq_register(uint8_t n, softirq_handler_t handler);
+
+void softirq_raise(uint8_t n);
+void softirq_run(void);
+
+#endif //TINY_OS_SOFTIRQ_H
@@ -0,0 +1,52 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        syscall.h
+//      Environment: Tiny OS
+//      Description: Contains the syscall numbers and the fast syscall frame shared between
+//                   the syscall entry (trap_vec.S) and the dispatcher (syscall.c).
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef TINY_OS_SYSCALL_H
+#define TINY_OS_SYSCALL_H
+
+// Syscall numbers, passed in a7. Plain defines (rather than an enum) so that user
+// assembly can use them too.
+#define SYS_PUTC        (0)
+#define SYS_GETPID      (1)
+#define SYS_YIELD       (2)
+#define SYS_SLEEP       (3)
+#define SYS_EXIT        (4)
+
+// The fast syscall frame (see u_trap_entry in trap_vec.S): the caller-saved registers,
+// the user stack pointer and the sepc/sstatus csrs — 19 doublewords against the 68 of
+// a full trap_frame_t. The callee-saved registers need no slots at all: the C calling
+// convention obliges syscall_dispatch to preserve them for us.
+//
+// The layout below must match the save/load offsets in u_trap_entry:
+//      slot 0          ra
+//      slots 1 - 8     a0 - a7
+//      slots 9 - 15    t0 - t6
+//      slot 16         sp (the *user* stack pointer)
+//      slot 17         sepc
+//      slot 18         sstatus
+#define SYSCALL_FRAME_SIZE (19 * 8)
+
+#ifndef __ASSEMBLER__
+
+#include <lib/stdint.h>
+
+typedef struct {
+    uint64_t ra;
+    uint64_t a[8];
+    uint64_t t[7];
+    uint64_t sp;
+    uint64_t epc;
+    uint64_t status;
+} syscall_frame_t;
+
+void syscall_dispatch(syscall_frame_t* frame);
+
+#endif
+
+#endif //TINY_OS_SYSCALL_H
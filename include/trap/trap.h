@@ -60,6 +60,10 @@ void s_trap(trap_frame_t* tf);
 
 void dump_trap_frame(const trap_frame_t* tf);
 
+// Dump the per-cause trap latency statistics (counts, cycle totals, worst case
+// and log-scale histograms) gathered by s_trap.
+void trap_stat_dump(void);
+
 // Trap vectors
 
 void s_trap_vec(void);
@@ -0,0 +1,174 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        bench.c
+//      Environment: Tiny OS
+//      Description: The in-kernel microbenchmark suite. Built into the image with -DBENCH (see
+//                   make bench), run from main on the boot hart once the scheduler is up, and
+//                   reporting cycles-per-op over the console — the before/after numbers every
+//                   performance change should come with.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <lib/stdint.h>
+#include <lib/stdbool.h>
+#include <lib/stdio.h>
+
+#include <debug.h>
+#include <riscv.h>
+
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+#include <mm/malloc.h>
+#include <mm/arena.h>
+
+#include <threads/thread.h>
+#include <threads/synch.h>
+
+#include <bench.h>
+
+#define BENCH_ITERS     (10000)
+
+static void bench_report(const char* name, uint64_t arg, uint64_t cycles, uint64_t iters) {
+    printf("bench: %s(%d): %d cycles/op over %d ops\n", name, arg, cycles / iters, iters);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PMM / MALLOC                                                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void bench_alloc_pages(void) {
+    for (size_t order = 0; order <= 3; order++) {
+        uint64_t start = r_cycle();
+        for (size_t i = 0; i < BENCH_ITERS; i++) {
+            void* p = alloc_pages(order);
+            free_pages(p, order);
+        }
+        bench_report("alloc_pages+free_pages", order, r_cycle() - start, BENCH_ITERS);
+    }
+}
+
+static void bench_malloc(void) {
+    static const size_t sizes[] = { 16, 64, 256, 1024, 4096 };
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint64_t start = r_cycle();
+        for (size_t i = 0; i < BENCH_ITERS; i++) {
+            void* p = malloc(sizes[s]);
+            free(p);
+        }
+        bench_report("malloc+free", sizes[s], r_cycle() - start, BENCH_ITERS);
+    }
+}
+
+// One create/alloc*/destroy cycle of a transient structure — the workload arenas
+// exist for. Compare against the 64-byte malloc+free figure above (times
+// BENCH_ARENA_ALLOCS) to see what the bump path buys.
+#define BENCH_ARENA_ALLOCS  (64)
+
+static void bench_arena(void) {
+    uint64_t start = r_cycle();
+    for (size_t i = 0; i < BENCH_ITERS; i++) {
+        arena_t* arena = arena_create();
+        for (size_t j = 0; j < BENCH_ARENA_ALLOCS; j++) {
+            arena_alloc(arena, 64);
+        }
+        arena_destroy(arena);
+    }
+    bench_report("arena create+64 allocs+destroy", 64, r_cycle() - start, BENCH_ITERS);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SCHEDULING / SYNCHRONIZATION                                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static volatile bool yield_stop;
+
+static void bench_yield_peer(UNUSED void* arg) {
+    while (!yield_stop) thread_yield();
+}
+
+// Context-switch latency via thread_yield ping-pong. Note that on a multi-hart
+// machine an idle sibling may steal the peer, in which case some yields re-pick
+// the calling thread and the figure drifts optimistic — run with the other harts
+// busy (or read it alongside the semaphore round trip below, which blocks and
+// therefore always pays the switch).
+static void bench_ctx_switch(void) {
+    yield_stop = false;
+    kthread_create("bench-yield", bench_yield_peer, null);
+
+    uint64_t start = r_cycle();
+    for (size_t i = 0; i < BENCH_ITERS; i++) thread_yield();
+    bench_report("thread_yield", 0, r_cycle() - start, BENCH_ITERS);
+
+    yield_stop = true;
+    thread_yield();
+}
+
+static semaphore_t ping;
+static semaphore_t pong;
+
+static void bench_sem_peer(UNUSED void* arg) {
+    for (size_t i = 0; i < BENCH_ITERS; i++) {
+        semaphore_down(&ping);
+        semaphore_up(&pong);
+    }
+}
+
+static void bench_semaphore(void) {
+    semaphore_init(&ping, 0);
+    semaphore_init(&pong, 0);
+    kthread_create("bench-sem", bench_sem_peer, null);
+
+    uint64_t start = r_cycle();
+    for (size_t i = 0; i < BENCH_ITERS; i++) {
+        semaphore_up(&ping);
+        semaphore_down(&pong);
+    }
+    bench_report("semaphore round trip", 0, r_cycle() - start, BENCH_ITERS);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// VMM                                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define BENCH_MAP_PAGES (512)
+
+static void bench_map_unmap(void) {
+    pagetable_t table = uvm_create();
+
+    uint64_t start = r_cycle();
+    for (size_t i = 0; i < BENCH_MAP_PAGES; i++) {
+        map(table, USER_TEXT_START + i * PAGE_SIZE, (paddr_t)alloc_page(), PAGE_SIZE,
+                PTE_R | PTE_W);
+    }
+    bench_report("map", 0, r_cycle() - start, BENCH_MAP_PAGES);
+
+    // (unmap frees the backing frames, so the alloc_page calls above balance out.)
+    start = r_cycle();
+    unmap(table, USER_TEXT_START, BENCH_MAP_PAGES * PAGE_SIZE);
+    bench_report("unmap", 0, r_cycle() - start, BENCH_MAP_PAGES);
+
+    uvm_destroy(table);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Procedure:   bench_run
+ * ----------------------
+ * Runs the full suite, in order from self-contained to scheduler-dependent.
+ * Called from main on the boot hart with the scheduler running.
+ *
+ */
+void bench_run(void) {
+    printf("bench: starting (%d iterations per benchmark)\n", BENCH_ITERS);
+
+    bench_alloc_pages();
+    bench_malloc();
+    bench_arena();
+    bench_map_unmap();
+    bench_ctx_switch();
+    bench_semaphore();
+
+    printf("bench: done\n");
+}
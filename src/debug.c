@@ -12,6 +12,8 @@
 #include <lib/stdarg.h>
 #include <lib/stdio.h>
 
+#include <dev/klog.h>
+
 #include <debug.h>
 
 /*
@@ -31,6 +33,10 @@ void kernel_panic(const char* file, int line, const char* function, const char*
     va_list va;
     va_start(va, message);
 
+    // Flush the log ring and switch logging into synchronous mode, so the backlog and
+    // the panic message below are guaranteed to reach the console.
+    klog_panic();
+
     printf("\x1b[0;31m[PANIC]\x1b[0m KERNEL PANIC at %s:%d in %s(): ", file, line, function);
     vprintf(message, va);
     printf("\n");
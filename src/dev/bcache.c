@@ -0,0 +1,205 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/9/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        bcache.c
+//      Environment: Tiny OS
+//      Description: The block buffer cache.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <lib/stdint.h>
+#include <lib/stdbool.h>
+#include <lib/list.h>
+
+#include <debug.h>
+
+#include <mm/pmm.h>
+
+#include <threads/spinlock.h>
+#include <threads/synch.h>
+
+#include <dev/virtio.h>
+#include <dev/bcache.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BUFFER CACHE                                                                                                        //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Every virtqueue round trip costs a doorbell VM exit plus an interrupt, and our access
+// patterns re-read the same few hundred sectors constantly — so sectors are cached in a
+// fixed pool of buffers:
+//
+//  - a hash table over the sector number finds a cached buffer quickly;
+//  - buffers with refcount == 0 sit on an lru list, and the *least* recently used one
+//    is recycled when a miss needs a buffer;
+//  - each buffer carries a sleeping lock, so a thread that wants a buffer another
+//    thread is using sleeps rather than spins.
+//
+// The index (hash buckets, lru list, refcounts) is guarded by a single spinlock —
+// every index operation is a handful of pointer updates. Device I/O happens with only
+// the buffer's own lock held, so a miss never blocks unrelated hits.
+//
+// Writes are write-through: bcache_write pushes the buffer to the device synchronously,
+// so recycled buffers are never dirty.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define BCACHE_NBUF         (64)
+#define BCACHE_NBUCKET      (16)
+
+#define SECTORS_PER_PAGE    (PAGE_SIZE / BLK_SECTOR_SIZE)
+
+static buf_t bufs[BCACHE_NBUF];
+
+static spinlock_t bcache_lock;
+static list_t buckets[BCACHE_NBUCKET];
+static list_t lru;
+
+static inline list_t* bucket_of(uint64_t sector) {
+    return &buckets[sector % BCACHE_NBUCKET];
+}
+
+void bcache_init(void) {
+    spinlock_init(&bcache_lock);
+    for (size_t i = 0; i < BCACHE_NBUCKET; i++) list_init(&buckets[i]);
+    list_init(&lru);
+
+    // Buffer data is carved out of whole pages (8 sectors per page).
+    uint8_t* page = null;
+    for (size_t i = 0; i < BCACHE_NBUF; i++) {
+        if (i % SECTORS_PER_PAGE == 0) {
+            page = alloc_page();
+            assert(page != null);
+        }
+
+        buf_t* b = &bufs[i];
+        b->sector = 0;
+        b->valid = false;
+        b->refcount = 0;
+        b->data = page + (i % SECTORS_PER_PAGE) * BLK_SECTOR_SIZE;
+        lock_init(&b->lock);
+
+        list_push_tail(bucket_of(0), &b->hash_node);
+        list_push_tail(&lru, &b->lru_node);
+    }
+}
+
+/*
+ * Function:    bcache_get
+ * -----------------------
+ * Looks up the buffer caching [sector], pinning it; on a miss, the least recently
+ * used unpinned buffer is recycled (it's cached contents are discarded — recycled
+ * buffers are never dirty, since writes are write-through).
+ *
+ * @uint64_t sector:    the sector number.
+ *
+ * @returns:            the pinned buffer, *locked*. b->valid tells the caller whether
+ *                      [data] already holds the sector's contents.
+ */
+static buf_t* bcache_get(uint64_t sector) {
+    intr_state_t state = spinlock_acquire(&bcache_lock);
+
+    // Is the sector already cached? Bucket membership (assigned under bcache_lock)
+    // is authoritative on it's own — a buffer that is mid-fill matches here too,
+    // and deliberately so: skipping it would recycle a *second* buffer for the same
+    // sector, and the two aliases would serve stale data forever after. A caller
+    // landing on a mid-fill buffer just blocks on b->lock until the fill completes,
+    // then sees b->valid.
+    list_t* bucket = bucket_of(sector);
+    for (list_node_t* it = list_head(bucket); it != &bucket->nil; it = it->next) {
+        buf_t* b = LIST_VALUE(buf_t, hash_node, it);
+        if (b->sector == sector) {
+            // Pin it; a buffer leaves the lru list while referenced.
+            if (b->refcount++ == 0) list_delete(&lru, &b->lru_node);
+
+            spinlock_release(&bcache_lock, state);
+
+            lock_acquire(&b->lock);
+            return b;
+        }
+    }
+
+    // Miss: recycle the least recently used unpinned buffer.
+    if (list_size(&lru) == 0) {
+        panic("bcache: all %d buffers pinned.\n", BCACHE_NBUF);
+    }
+    buf_t* b = LIST_VALUE(buf_t, lru_node, list_pop_tail(&lru));
+
+    list_delete(bucket_of(b->sector), &b->hash_node);
+    b->sector = sector;
+    b->valid = false;
+    b->refcount = 1;
+    list_push_tail(bucket, &b->hash_node);
+
+    spinlock_release(&bcache_lock, state);
+
+    lock_acquire(&b->lock);
+    return b;
+}
+
+/*
+ * Function:    bcache_read
+ * ------------------------
+ * Returns a locked, pinned buffer holding the contents of [sector], reading it from
+ * the device only on a cache miss. The caller must hand the buffer back with
+ * bcache_release.
+ *
+ * @uint64_t sector:    the sector number.
+ *
+ * @returns:            the buffer; b->data holds the sector's contents.
+ */
+buf_t* bcache_read(uint64_t sector) {
+    assert(virtio_blk_present());
+
+    buf_t* b = bcache_get(sector);
+
+    if (!b->valid) {
+        virtio_blk_req_t req;
+        req.sector = b->sector;
+        req.data = b->data;
+        req.write = false;
+        virtio_blk_rw(&req);
+
+        b->valid = true;
+    }
+
+    return b;
+}
+
+/*
+ * Procedure:   bcache_write
+ * -------------------------
+ * This procedure writes [b]'s contents through to the device (synchronously). The
+ * caller must hold the buffer (i.e. it came from bcache_read and has not yet been
+ * released).
+ *
+ * @buf_t* b:   the buffer that is to be written.
+ *
+ */
+void bcache_write(buf_t* b) {
+    assert(b != null && b->refcount > 0);
+
+    virtio_blk_req_t req;
+    req.sector = b->sector;
+    req.data = b->data;
+    req.write = true;
+    virtio_blk_rw(&req);
+}
+
+/*
+ * Procedure:   bcache_release
+ * ---------------------------
+ * This procedure unlocks and unpins [b]. Once the last reference is dropped, the
+ * buffer joins the head of the lru list (it's contents stay cached until recycled).
+ *
+ * @buf_t* b:   the buffer that is to be released.
+ *
+ */
+void bcache_release(buf_t* b) {
+    assert(b != null && b->refcount > 0);
+
+    lock_release(&b->lock);
+
+    intr_state_t state = spinlock_acquire(&bcache_lock);
+    if (--b->refcount == 0) {
+        list_push_head(&lru, &b->lru_node);
+    }
+    spinlock_release(&bcache_lock, state);
+}
@@ -0,0 +1,148 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        fdt.c
+//      Environment: Tiny OS
+//      Description: A minimal flattened device tree (FDT) parser. QEMU passes the physical address
+//                   of the device tree blob in a1 at reset (stashed by boot.S); the only thing the
+//                   kernel currently wants from it is the /memory node, so one image can size it's
+//                   physical memory manager to the machine it actually booted on instead of the
+//                   linker's baked-in size.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <lib/stdint.h>
+#include <lib/stdbool.h>
+#include <lib/string.h>
+
+#include <debug.h>
+
+#include <mm/symbols.h>
+
+#include <dev/fdt.h>
+
+// Set by boot.S before init is called; lives in the BSS (the store happens after
+// the BSS clear).
+uint64_t fdt_pointer;
+
+// The FDT wire format: a header followed by a structure block of big-endian
+// 32-bit tokens, with property names in a separate strings block.
+#define FDT_MAGIC       (0xd00dfeed)
+
+#define FDT_BEGIN_NODE  (0x1)
+#define FDT_END_NODE    (0x2)
+#define FDT_PROP        (0x3)
+#define FDT_NOP         (0x4)
+#define FDT_END         (0x9)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t totalsize;
+    uint32_t off_dt_struct;
+    uint32_t off_dt_strings;
+    uint32_t off_mem_rsvmap;
+    uint32_t version;
+    uint32_t last_comp_version;
+    uint32_t boot_cpuid_phys;
+    uint32_t size_dt_strings;
+    uint32_t size_dt_struct;
+} fdt_header_t;
+
+// Everything in the blob is big-endian.
+#define be32(x) (__builtin_bswap32(x))
+
+// The discovered end of RAM (0 until parsed / if the blob is absent or malformed).
+static uint64_t memory_end;
+static bool parsed;
+
+/*
+ * Procedure:   fdt_parse
+ * ----------------------
+ * Walks the structure block looking for the /memory node and accumulates the end
+ * addresses of it's "reg" regions. The qemu virt machine uses 2 address cells and
+ * 2 size cells, so "reg" is a sequence of (base, size) pairs of big-endian u64s —
+ * read as u32 halves, since the property data is only 4-byte aligned.
+ *
+ */
+static void fdt_parse(void) {
+    parsed = true;
+
+    if (fdt_pointer == 0) return;
+
+    fdt_header_t* header = (fdt_header_t*)fdt_pointer;
+    if (be32(header->magic) != FDT_MAGIC) {
+        warn("FDT: bad magic %#x at %p.\n", be32(header->magic), fdt_pointer);
+        return;
+    }
+
+    uint32_t* p = (uint32_t*)(fdt_pointer + be32(header->off_dt_struct));
+    const char* strings = (const char*)(fdt_pointer + be32(header->off_dt_strings));
+
+    bool in_memory_node = false;
+    int depth = 0;
+
+    while (true) {
+        uint32_t token = be32(*p++);
+
+        if (token == FDT_END) break;
+        if (token == FDT_NOP) continue;
+
+        if (token == FDT_BEGIN_NODE) {
+            // The node name follows, nul terminated and padded to 4 bytes.
+            const char* name = (const char*)p;
+            p += (strlen(name) + 1 + 3) / 4;
+
+            depth++;
+            in_memory_node = depth == 2 && memcmp(name, "memory", 6) == 0;
+            continue;
+        }
+
+        if (token == FDT_END_NODE) {
+            depth--;
+            in_memory_node = false;
+            continue;
+        }
+
+        if (token == FDT_PROP) {
+            uint32_t len = be32(*p++);
+            const char* name = strings + be32(*p++);
+
+            if (in_memory_node && memcmp(name, "reg", 4) == 0) {
+                for (uint32_t i = 0; i + 4 <= len / 4; i += 4) {
+                    uint64_t base = ((uint64_t)be32(p[i]) << 32) | be32(p[i + 1]);
+                    uint64_t size = ((uint64_t)be32(p[i + 2]) << 32) | be32(p[i + 3]);
+
+                    if (base + size > memory_end) memory_end = base + size;
+                }
+            }
+
+            p += (len + 3) / 4;
+            continue;
+        }
+
+        // An unknown token: the blob is malformed (or our pointer arithmetic is
+        // off) — bail out rather than wander off into the weeds.
+        warn("FDT: unknown token %#x, abandoning parse.\n", token);
+        memory_end = 0;
+        return;
+    }
+}
+
+/*
+ * Function:    fdt_memory_end
+ * ---------------------------
+ * Returns the end of physical memory as reported by the device tree's /memory
+ * node, falling back to the linker's baked-in MEMORY_END when no (valid) device
+ * tree was handed over. Parsed once, on first call — which must happen before the
+ * PMM hands out the blob's pages as free memory.
+ *
+ * @returns:    the physical address one past the last byte of RAM.
+ *
+ */
+uint64_t fdt_memory_end(void) {
+    if (!parsed) {
+        fdt_parse();
+        if (memory_end != 0) info("FDT: physical memory ends at %p.\n", memory_end);
+    }
+
+    return memory_end != 0 ? memory_end : MEMORY_END;
+}
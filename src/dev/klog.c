@@ -0,0 +1,228 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/2/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        klog.c
+//      Environment: Tiny OS
+//      Description: Contains the kernel log (klog) subsystem and the console implementation of vprintf.
+//                   printf callers append formatted characters to a fixed in-memory ring which a
+//                   low-priority flusher thread drains to the UART, so formatting is decoupled from
+//                   115200-baud emission. The ring doubles as a post-mortem dmesg buffer.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <lib/ctype.h>
+#include <lib/stdint.h>
+#include <lib/stdbool.h>
+#include <lib/stdarg.h>
+#include <lib/stdio.h>
+
+#include <debug.h>
+
+#include <mm/pmm.h>
+
+#include <trap/interrupt.h>
+
+#include <threads/thread.h>
+
+#include <dev/timer.h>
+#include <dev/uart.h>
+
+#include <dev/klog.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// LOG RING                                                                                                           //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The log ring is a contiguous block of pages (allocated from alloc_pages during klog_init).
+// printf producers (on any hart, possibly in interrupt context) append characters at [head]
+// and the flusher thread drains them to the UART from [tail].
+//
+// As with the UART rings, the ring size is a power of two and the indices increment forever,
+// being reduced modulo the ring size via masking. If producers outpace the flusher, the
+// oldest unflushed characters are overwritten (dmesg-style) rather than stalling the producer.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The log ring occupies 2^KLOG_RING_ORDER pages.
+#define KLOG_RING_ORDER     (2)
+#define KLOG_RING_SIZE      (PAGE_SIZE << KLOG_RING_ORDER)
+
+// The number of timer ticks the flusher thread sleeps between drains.
+#define KLOG_FLUSH_INTERVAL (100000)
+
+static uchar_t* klog_ring = null;
+static volatile uint64_t klog_head;     // producer index (klog_putc)
+static volatile uint64_t klog_tail;     // consumer index (klog_flush)
+
+// Producers on sibling harts may append concurrently, so the ring is protected by a
+// test-and-set guard (held with interrupts disabled).
+static volatile uint64_t klog_guard;
+
+// Once the kernel has panicked, the log is flushed and all subsequent output bypasses
+// the ring, so the panic message is guaranteed to reach the console.
+static volatile bool klog_sync = false;
+
+static inline void klog_lock(void) {
+    while (__sync_lock_test_and_set(&klog_guard, 1) != 0);
+}
+
+static inline void klog_unlock(void) {
+    __sync_lock_release(&klog_guard);
+}
+
+/*
+ * Procedure:   klog_flush
+ * -----------------------
+ * This procedure drains the log ring to the UART. It is invoked periodically by the
+ * flusher thread and synchronously by klog_panic.
+ *
+ */
+static void klog_flush(void) {
+    intr_state_t state = intr_disable();
+    klog_lock();
+
+    while (klog_tail != klog_head) {
+        uchar_t c = klog_ring[klog_tail++ & (KLOG_RING_SIZE - 1)];
+
+        // Drop the guard while emitting; uart_putc takes it's own transmit guard and
+        // may synchronously drain, during which producers should not be blocked.
+        klog_unlock();
+        uart_putc(c);
+        klog_lock();
+    }
+
+    klog_unlock();
+    intr_set_state(state);
+}
+
+/*
+ * Procedure:   klog_flusher
+ * -------------------------
+ * The body of the flusher thread: periodically drain the log ring to the UART.
+ * The thread runs at (nearly) the lowest priority, so flushing only consumes cycles
+ * that would otherwise be spent idling.
+ *
+ */
+static void klog_flusher(UNUSED void* data) {
+    for (;;) {
+        klog_flush();
+        timer_sleep(KLOG_FLUSH_INTERVAL);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// EXTERNAL KLOG METHODS                                                                                              //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Procedure:   klog_init
+ * ----------------------
+ * This procedure allocates the log ring. Prior to klog_init, printf output falls
+ * through to the UART synchronously (the early-boot path), so logging works from the
+ * very first instruction of main.
+ *
+ */
+void klog_init() {
+    klog_ring = alloc_pages(KLOG_RING_ORDER);
+    assert(klog_ring != null);
+
+    klog_head = 0;
+    klog_tail = 0;
+}
+
+/*
+ * Procedure:   klog_flusher_init
+ * ------------------------------
+ * This procedure creates the flusher thread. It must be called once the scheduler has
+ * been started on the boot hart.
+ *
+ * Note that the flusher runs at PRI_MIN + 1 (not PRI_MIN) so it is never starved by
+ * (or co-scheduled with) the idle threads.
+ *
+ */
+void klog_flusher_init() {
+    kthread_create_with_priority("klog", klog_flusher, null, PRI_MIN + 1);
+}
+
+/*
+ * Procedure:   klog_putc
+ * ----------------------
+ * This procedure appends a character to the log ring. If the ring has not yet been
+ * allocated (early boot) or the kernel has panicked, the character is emitted
+ * synchronously to the UART instead.
+ *
+ * @uchar_t c:  The character that is to be logged.
+ *
+ */
+void klog_putc(uchar_t c) {
+    if (klog_ring == null || klog_sync) {
+        uart_putc(c);
+        return;
+    }
+
+    intr_state_t state = intr_disable();
+    klog_lock();
+
+    // If the ring is full, overwrite the oldest unflushed character (dmesg-style).
+    if (klog_head - klog_tail == KLOG_RING_SIZE) {
+        klog_tail++;
+    }
+
+    klog_ring[klog_head++ & (KLOG_RING_SIZE - 1)] = c;
+
+    klog_unlock();
+    intr_set_state(state);
+}
+
+/*
+ * Procedure:   klog_panic
+ * -----------------------
+ * This procedure is invoked by kernel_panic: the backlog is flushed to the console and
+ * the klog is switched into synchronous mode, so the panic message itself (and any
+ * output after it) bypasses the ring. After all, the flusher thread is unlikely to be
+ * scheduled again :)
+ *
+ */
+void klog_panic() {
+    klog_sync = true;
+
+    if (klog_ring != null) {
+        klog_flush();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CONSOLE VPRINTF                                                                                                    //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The block sink for __vprintf: a whole converted run goes into the ring under a
+// single lock round trip, rather than paying the lock (and interrupt toggle) per
+// character as klog_putc does.
+static inline void buf_putn(const char* s, size_t n, void* buf) {
+    int* count = (int*)buf;
+    *count += n;
+
+    if (klog_ring == null || klog_sync) {
+        for (size_t i = 0; i < n; i++) uart_putc(s[i]);
+        return;
+    }
+
+    intr_state_t state = intr_disable();
+    klog_lock();
+
+    for (size_t i = 0; i < n; i++) {
+        // If the ring is full, overwrite the oldest unflushed character (dmesg-style).
+        if (klog_head - klog_tail == KLOG_RING_SIZE) {
+            klog_tail++;
+        }
+
+        klog_ring[klog_head++ & (KLOG_RING_SIZE - 1)] = s[i];
+    }
+
+    klog_unlock();
+    intr_set_state(state);
+}
+
+int vprintf(const char* format, va_list va) {
+
+    int n = 0;
+    __vprintf(format, va, buf_putn, &n);
+    return n;
+}
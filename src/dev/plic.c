@@ -16,6 +16,7 @@
 #include <mm/vmm.h>
 
 #include <dev/uart.h>
+#include <dev/virtio.h>
 #include <dev/plic.h>
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -197,6 +198,9 @@ void plic_handle_interrupt(trap_frame_t* tf) {
         case PLIC_UART0_IRQ:
             uart_handle_interrupt(tf);
             break;
+        case PLIC_VIRTIO_IRQ:
+            virtio_blk_handle_interrupt(tf);
+            break;
         default:
             panic("Unhandled external interrupt. Hart: %d, interrupt: %d.\n", r_hartid(), irq);
             break;
@@ -215,6 +219,7 @@ void plic_handle_interrupt(trap_frame_t* tf) {
  */
 void plic_init() {
     plic_irq_priority(PLIC_UART0_IRQ, 1);
+    plic_irq_priority(PLIC_VIRTIO_IRQ, 1);
 }
 
 void plic_vm_init() {
@@ -232,6 +237,7 @@ void plic_vm_init() {
  */
 void plic_hart_init() {
     plic_irq_enable(PLIC_UART0_IRQ);
+    plic_irq_enable(PLIC_VIRTIO_IRQ);
     plic_irq_threshold(0);
 }
 
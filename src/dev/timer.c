@@ -7,6 +7,7 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include <lib/stdint.h>
+#include <lib/pheap.h>
 
 #include <param.h>
 #include <riscv.h>
@@ -18,6 +19,7 @@
 #include <trap/interrupt.h>
 
 #include <threads/thread.h>
+#include <threads/seqlock.h>
 
 #include <dev/timer.h>
 
@@ -58,25 +60,49 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /*
- * To handle timer interrupts, we somewhere to store the mtimecmp mmio address and the
- * timer interval. We also some additional space to save the values stored in the
- * temporary registers that we use during the timer interrupt vector. Our assembly code
- * only uses the registers t1, t2 and t3. Hence our mscratch area requires 5 8 byte entries.
+ * To handle timer interrupts, we somewhere to store the mtimecmp mmio address. We also
+ * some additional space to save the values stored in the temporary registers that we use
+ * during the timer interrupt vector. Our assembly code only uses the registers t1, t2
+ * and t3. Hence our mscratch area requires 5 8 byte entries.
  */
 static uint64_t mscratch[NUM_HART][5];
 
-// The number of timer ticks since the OS booted.
-static volatile uint64_t ticks;
+// A parked comparator: mtime never reaches all-ones, so a hart whose mtimecmp holds
+// TIMER_DEADLINE_NONE takes no timer interrupts at all.
+#define TIMER_DEADLINE_NONE     ((uint64_t)-1)
+
+// Each hart keeps a queue of sleeping threads — a pairing heap ordered by
+// thread->wakeup_tick, so insertion is O(1) and the nearest deadline is always at the
+// root (sorted-list insertion was O(n) in the number of sleepers). Since a blocked
+// thread stays on the hart it slept on until woken, the queues are only ever touched
+// by their owning hart (with interrupts disabled), so no locking is required.
+static pheap_t sleep_queues[NUM_HART];
+
+static bool sleep_queue_less(pheap_node_t* a, pheap_node_t* b) {
+    return PHEAP_VALUE(thread_t, sleep_node, a)->wakeup_tick
+            < PHEAP_VALUE(thread_t, sleep_node, b)->wakeup_tick;
+}
+
+// The tick at which the hart's slice/wakeup accounting was last settled (see
+// timer_rearm and timer_handle_interrupt).
+static uint64_t last_tick[NUM_HART];
+
+static inline uint64_t mtime_now() {
+    return *(volatile uint64_t*)CLINT_MTIME;
+}
 
 void timer_init() {
     uint64_t hartid = r_hartid();
 
+    pheap_init(&sleep_queues[hartid], sleep_queue_less);
+
     uint64_t* scratch = &mscratch[hartid][0];
 
     scratch[0] = CLINT_MTIMECMP(hartid);
-    scratch[1] = TIMER_INTERVAL;
 
-    *(uint64_t*)scratch[0] = *(uint64_t*)CLINT_MTIME + TIMER_INTERVAL;
+    // Arm the boot tick; once the scheduler is running, mtimecmp is reprogrammed
+    // on demand by timer_rearm.
+    *(uint64_t*)scratch[0] = mtime_now() + TIMER_INTERVAL;
 
     w_mtvec(MTVEC((uintptr_t)m_trap_vec, MTVEC_MODE_DIRECT));
     w_mscratch((uintptr_t)scratch);
@@ -98,14 +124,10 @@ void timer_vm_init() {
 }
 
 uint64_t timer_ticks() {
-    // Disable all interrupts
-    intr_state_t state = intr_disable();
-
-    uint64_t t = ticks;
-
-    // Return the interruptor to it's previous setting
-    intr_set_state(state);
-    return t;
+    // A tick is TIMER_INTERVAL cycles of mtime. Deriving the tick count from mtime
+    // (rather than counting interrupts) keeps time correct now that interrupts only
+    // fire at actual deadlines — and makes ticks consistent across harts for free :)
+    return mtime_now() / TIMER_INTERVAL;
 }
 
 uint64_t timer_elapsed(uint64_t then) {
@@ -115,21 +137,188 @@ uint64_t timer_elapsed(uint64_t then) {
     return t - then;
 }
 
-void timer_sleep(uint64_t t) {
-    uint64_t ticks0 = timer_ticks();
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// KERNEL CLOCK                                                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// A tick (TIMER_INTERVAL mtime cycles) is far too coarse for latency work, so time_ns converts
+// mtime — read via the time CSR, which QEMU's virt machine drives at 10MHz and which is consistent
+// across harts — straight to nanoseconds. The scale factor is cached in 32.32 fixed point (one
+// multiply and a shift per read, no divides), and the multi-word clock state (scale plus the
+// re-base pair that keeps the clock monotonic across recalibration) sits behind a seqlock:
+// readers never disable interrupts and never block a writer, they just retry on the (rare) race.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The mtime frequency of QEMU's virt machine.
+#define MTIME_FREQ      (10000000L)
+
+#define NS_PER_SEC      (1000000000L)
+
+// Statically initialized (a zeroed seqlock is a valid, unlocked one) so the clock is
+// readable from the moment the boot hart can execute C — no init-order dance.
+static struct {
+    seqlock_t lock;
+
+    // Nanoseconds per mtime cycle, in 32.32 fixed point.
+    uint64_t mult;
+
+    // The re-base pair: mtime and the clock's reading at the last recalibration.
+    uint64_t base_time;
+    uint64_t base_ns;
+} clock = {
+    .mult = (NS_PER_SEC << 32) / MTIME_FREQ,
+};
+
+/*
+ * Function:    time_ns
+ * --------------------
+ * This function returns the kernel clock: nanoseconds of monotonic time, at mtime
+ * resolution (100ns on QEMU's virt machine). Cheap enough to call from
+ * instrumentation — a CSR read, a multiply and a shift, with no interrupt
+ * round-trip — and safe from any context, including trap handlers.
+ *
+ * @returns:    The current time in nanoseconds.
+ *
+ */
+uint64_t time_ns(void) {
+    uint64_t sequence, mult, base_time, base_ns;
+
+    do {
+        sequence = seqlock_read_begin(&clock.lock);
+
+        mult = clock.mult;
+        base_time = clock.base_time;
+        base_ns = clock.base_ns;
+    } while (seqlock_read_retry(&clock.lock, sequence));
+
+    // The 128-bit intermediate keeps the multiply exact for any uptime.
+    return base_ns + (uint64_t)(((uint128_t)(r_time() - base_time) * mult) >> 32);
+}
+
+/*
+ * Procedure:   timer_clock_calibrate
+ * ----------------------------------
+ * This procedure re-scales the clock for an mtime frequency of [freq] Hz (for
+ * targets where the timebase isn't QEMU's 10MHz). The clock is re-based at the
+ * moment of the switch, so readings stay monotonic: time already elapsed is
+ * settled under the old scale and only time after the switch uses the new one.
+ *
+ * @uint64_t freq:  The mtime frequency in Hz.
+ *
+ */
+void timer_clock_calibrate(uint64_t freq) {
+    assert(freq != 0);
+
+    intr_state_t state = seqlock_write_begin(&clock.lock);
+
+    uint64_t now = r_time();
+    clock.base_ns += (uint64_t)(((uint128_t)(now - clock.base_time) * clock.mult) >> 32);
+    clock.base_time = now;
+    clock.mult = ((uint64_t)NS_PER_SEC << 32) / freq;
+
+    seqlock_write_end(&clock.lock, state);
+}
 
+/*
+ * Procedure:   timer_sleep
+ * ------------------------
+ * This procedure puts the current thread to sleep for at least [t] timer ticks.
+ * The thread is inserted into the current hart's sleep queue (ordered by it's wake-up
+ * deadline) and blocked; timer_handle_interrupt unblocks it once the deadline passes.
+ *
+ * Note that this procedure must be called with interrupts enabled (it sleeps!).
+ *
+ * @uint64_t t:     The number of timer ticks to sleep for.
+ *
+ */
+void timer_sleep(uint64_t t) {
     assert(intr_get_state() == INTR_ON);
 
-    info("%d thread\n", thread_current()->tid);
-    info("%d ticks0\n", ticks0);
+    thread_t* cur = thread_current();
 
-    while (timer_elapsed(ticks0) < t) {
-        thread_yield();
-        if (timer_elapsed(ticks0) > 0) info("Yay!\n");
+    intr_state_t state = intr_disable();
+
+    uint64_t hartid = r_hartid();
+    cur->wakeup_tick = timer_ticks() + t;
+
+    // Compiled out below LOG_LEVEL_DEBUG — this fires on every sleep, so it must
+    // never cost a printf in a production image.
+    debug("Thread %d sleeping until tick %d.\n", cur->tid, cur->wakeup_tick);
+
+    // Insert the thread into the sleep queue; the heap keeps the nearest deadline at
+    // the root, so the interrupt handler only ever inspects the root.
+    pheap_push(&sleep_queues[hartid], &cur->sleep_node);
+
+    // Our deadline may be nearer than whatever the comparator currently holds
+    // (the hart may even have it parked).
+    timer_rearm();
+
+    thread_block();
+
+    intr_set_state(state);
+}
+
+/*
+ * Procedure:   timer_rearm
+ * ------------------------
+ * This procedure programs the current hart's comparator with the next *actual* deadline:
+ * the earlier of the nearest sleeper's wake-up and the running thread's preemption slice
+ * expiry. The idle thread has no slice, so an idle hart with no sleepers parks it's
+ * comparator and takes no timer interrupts at all (work stealing doesn't need them —
+ * the idle loop runs through the scheduler).
+ *
+ * Called whenever either deadline may have changed: after every timer interrupt, after
+ * every dispatch (see __schedule_tail) and when a thread goes to sleep.
+ *
+ * Note that this procedure must be called with interrupts disabled.
+ *
+ */
+void timer_rearm(void) {
+    assert(intr_get_state() == INTR_OFF);
+
+    uint64_t hartid = r_hartid();
+    uint64_t deadline = TIMER_DEADLINE_NONE;
+
+    // The nearest sleeper's deadline sits at the root of the sleep queue.
+    pheap_t* queue = &sleep_queues[hartid];
+    if (pheap_size(queue) != 0) {
+        thread_t* t = PHEAP_VALUE(thread_t, sleep_node, pheap_peek(queue));
+        deadline = t->wakeup_tick * TIMER_INTERVAL;
+    }
+
+    // The preemption deadline of the running thread (the idle thread is never
+    // preempted on a slice).
+    thread_t* cur = thread_current();
+    if (cur != hart_current()->idle_thread) {
+        uint64_t slice = mtime_now() + cur->scheduler_info.time * TIMER_INTERVAL;
+        if (slice < deadline) deadline = slice;
     }
+
+    // Slice/wakeup accounting is settled up to now (see timer_handle_interrupt).
+    last_tick[hartid] = timer_ticks();
+
+    *(uint64_t*)CLINT_MTIMECMP(hartid) = deadline;
 }
 
 void timer_handle_interrupt(UNUSED trap_frame_t* tf) {
-    ticks++;
-    scheduler_tick();
+    uint64_t hartid = r_hartid();
+    uint64_t now = timer_ticks();
+
+    // The number of ticks since this hart's accounting was last settled; charged
+    // against the running thread's time slice by scheduler_tick.
+    uint64_t elapsed = now - last_tick[hartid];
+
+    // Wake any sleeping threads whose deadline has passed. The sleep queue is a
+    // min-heap on wakeup_tick, so we only ever inspect the root.
+    pheap_t* queue = &sleep_queues[hartid];
+    while (pheap_size(queue) != 0) {
+        thread_t* t = PHEAP_VALUE(thread_t, sleep_node, pheap_peek(queue));
+        if (t->wakeup_tick > now) break;
+
+        pheap_pop(queue);
+        thread_unblock(t);
+    }
+
+    scheduler_tick(elapsed);
+
+    timer_rearm();
 }
\ No newline at end of file
@@ -3,21 +3,24 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //      File:        uart.c
 //      Environment: Tiny OS
-//      Description: Contains methods for interacting with QEMU's UART controller which uses MMIO registers
-//                   We use polling for writing and reading characters from UART (and will eventually use external
-//                   interrupts for reading)
+//      Description: Contains methods for interacting with QEMU's UART controller which uses MMIO registers.
+//                   Transmit and receive are interrupt-driven: characters are staged in software ring buffers
+//                   which are drained/filled on THR-empty and receive interrupts respectively.
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include <lib/ctype.h>
 #include <lib/stdint.h>
-#include <lib/stdarg.h>
-#include <lib/stdio.h>
 
 #include <debug.h>
 
 #include <mm/vmm.h>
 #include <mm/pmm.h>
 
+#include <trap/interrupt.h>
+#include <trap/softirq.h>
+
+#include <threads/synch.h>
+
 #include <dev/uart.h>
 
 /***********************************************************************************************************************
@@ -48,6 +51,13 @@
 #define DR_MASK     (1 << 0)  // Data Ready bit (in LSR) mask
 #define THR_MASK    (1 << 5)  // Transmitter holding register bit (in LSR) mask
 
+#define IER_RX_ENABLE   (1 << 0)  // Receiver buffer interrupt enable (in IER)
+#define IER_TX_ENABLE   (1 << 1)  // Transmitter holding register empty interrupt enable (in IER)
+
+// The 16550's hardware transmit FIFO holds 16 bytes; when the LSR reports the
+// transmitter holding register empty, we may push up to a full FIFO's worth.
+#define UART_FIFO_DEPTH (16)
+
 
 /*
  * Procedure:   mmio_write
@@ -76,6 +86,74 @@ static inline uchar_t mmio_read(uint64_t reg) {
     return *(volatile uchar_t*)reg;
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TX / RX RING BUFFERS                                                                                               //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Rather than polling the LSR for every byte, we buffer output in a transmit ring that is drained
+// into the hardware FIFO on THR-empty interrupts, and buffer input in a receive ring that is filled
+// from the hardware FIFO on receive interrupts. uart_putc callers therefore never spin on THR_MASK
+// (unless the ring itself is full, in which case we fall back to a synchronous drain).
+//
+// The ring sizes must be powers of two: the head/tail indices increment forever and are
+// reduced modulo the ring size via masking.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define UART_TX_RING_SIZE   (1024)
+#define UART_RX_RING_SIZE   (256)
+
+static uchar_t tx_ring[UART_TX_RING_SIZE];
+static volatile uint64_t tx_head;   // producer index (uart_putc)
+static volatile uint64_t tx_tail;   // consumer index (uart_start_tx)
+
+static uchar_t rx_ring[UART_RX_RING_SIZE];
+static volatile uint64_t rx_head;   // producer index (uart_handle_interrupt)
+static volatile uint64_t rx_tail;   // consumer index (uart_getc)
+
+// Readers sleep on [rx_avail] rather than spinning on the ring indices; the receive
+// interrupt signals it whenever new input lands in the ring.
+static lock_t rx_lock;
+static cond_t rx_avail;
+
+static void uart_rx_softirq(void);
+
+// The transmit state is shared between uart_putc callers on every hart and the interrupt
+// handler, so it's guarded by a test-and-set spin guard (held with interrupts disabled).
+static volatile uint64_t tx_guard;
+
+static inline void uart_tx_lock(void) {
+    while (__sync_lock_test_and_set(&tx_guard, 1) != 0);
+}
+
+static inline void uart_tx_unlock(void) {
+    __sync_lock_release(&tx_guard);
+}
+
+/*
+ * Procedure:   uart_start_tx
+ * --------------------------
+ * This procedure drains the transmit ring into the hardware FIFO. If the transmitter
+ * is idle, we refill the FIFO with up to UART_FIFO_DEPTH bytes; the THR-empty interrupt
+ * is then enabled iff the ring still holds bytes, so the ring continues to drain from
+ * the interrupt handler without the sender polling.
+ *
+ * Note that the tx_guard must be held (with interrupts disabled) by the caller.
+ *
+ */
+static void uart_start_tx(void) {
+    if ((mmio_read(LSR) & THR_MASK) != 0) {
+        for (int i = 0; i < UART_FIFO_DEPTH && tx_tail != tx_head; i++) {
+            mmio_write(THR, tx_ring[tx_tail++ & (UART_TX_RING_SIZE - 1)]);
+        }
+    }
+
+    // Request a THR-empty interrupt iff there are still bytes to send.
+    if (tx_tail != tx_head) {
+        mmio_write(IER, IER_RX_ENABLE | IER_TX_ENABLE);
+    } else {
+        mmio_write(IER, IER_RX_ENABLE);
+    }
+}
+
 /*
  * Procedure:   uart_init
  * ----------------------
@@ -113,11 +191,18 @@ void uart_init() {
     // and unset the DLAB bit.
     mmio_write(LCR, 0x03);
 
-    // and enable the FIFO, which is bit 0 of FCR.
-    mmio_write(FCR, 0x01);
+    // Enable the FIFOs (bit 0 of FCR) and clear both the receive and transmit
+    // FIFOs (bits 1 and 2). We keep the receive trigger level at 1 byte (bits 6-7 = 0)
+    // so console input stays low-latency.
+    mmio_write(FCR, 0x07);
 
-    // Enable reciever buffer interrupt, bit 0 of the IER.
-    mmio_write(IER, 0x01);
+    // Enable the reciever buffer interrupt. The THR-empty interrupt is toggled on
+    // demand by uart_start_tx.
+    mmio_write(IER, IER_RX_ENABLE);
+
+    lock_init(&rx_lock);
+    cond_init(&rx_avail);
+    softirq_register(SOFTIRQ_UART_RX, uart_rx_softirq);
 }
 
 void uart_vm_init() {
@@ -128,63 +213,98 @@ void uart_vm_init() {
 /*
  * Function:   uart_getc
  * ---------------------
- * This function returns a character if one is sent by the UART controller.
- * We do this by polling the controller until the data ready bit (in the LSR register)
- * is set.
- *
- * Once the data ready bit is set, we simply read the receiver buffer register (RBR).
+ * This function returns the next character from the receive ring, which is filled by
+ * uart_handle_interrupt whenever the controller's receive FIFO holds data.
  *
- * @returns:    The character stored in the RBR register.
- *              If no character is sent via the device controller
- *              then procedure hangs (due to the nature of polling...)
+ * @returns:    The next received character.
+ *              If no character has been received, the function waits for
+ *              the interrupt handler to fill the ring.
  *
  */
 uchar_t uart_getc() {
-    while ((mmio_read(LSR) & DR_MASK) != 0) ;
-    return mmio_read(RBR);
+    lock_acquire(&rx_lock);
+
+    // Sleep until the interrupt handler fills the receive ring.
+    while (rx_head == rx_tail) {
+        cond_wait(&rx_avail, &rx_lock);
+    }
+    uchar_t c = rx_ring[rx_tail++ & (UART_RX_RING_SIZE - 1)];
+
+    lock_release(&rx_lock);
+    return c;
 }
 
 
 /*
  * Procedure:   uart_putc
  * ----------------------
- * This function writes a character in the transmitter holding register of the UART controller
- * if and only if the transmitter holding ready bit is set. Otherwise we'd be overwriting data
- * that is currently being sent :(
+ * This procedure appends a character to the transmit ring; the ring is drained into the
+ * controller's FIFO by uart_start_tx (here and on THR-empty interrupts), so the caller
+ * never waits for the line itself.
+ *
+ * If the ring is full (the line has been outpaced for a sustained burst), we fall back to
+ * synchronously draining a byte to the device to make room.
  *
  * @uchar_t c:  The character that is to be sent by the UART controller.
  *
  */
 void uart_putc(uchar_t c) {
-    while ((mmio_read(LSR) & THR_MASK) == 0) ;
-    mmio_write(THR, c);
+    intr_state_t state = intr_disable();
+    uart_tx_lock();
+
+    // Fallback: the ring is full, so poll a byte out of the ring to make room.
+    while (tx_head - tx_tail == UART_TX_RING_SIZE) {
+        while ((mmio_read(LSR) & THR_MASK) == 0) ;
+        mmio_write(THR, tx_ring[tx_tail++ & (UART_TX_RING_SIZE - 1)]);
+    }
+
+    tx_ring[tx_head++ & (UART_TX_RING_SIZE - 1)] = c;
+    uart_start_tx();
+
+    uart_tx_unlock();
+    intr_set_state(state);
 }
 
 
+/*
+ * Procedure:   uart_rx_softirq
+ * ----------------------------
+ * The soft half of the receive path: wakes any thread sleeping in uart_getc. Waking a
+ * thread walks scheduler state, so it's deferred out of the hard handler (which runs
+ * between plic_claim and plic_complete with interrupts off).
+ *
+ */
+static void uart_rx_softirq(void) {
+    cond_signal(&rx_avail);
+}
+
 /*
  * Procedure:   uart_handle_interrupt
  * ----------------------------------
- * This procedure returns
+ * The hard half of the UART interrupt: does only what the controller needs to deassert
+ * it's interrupt line. On receive, the hardware FIFO is drained into the receive ring
+ * (readers are woken later, from uart_rx_softirq); on THR-empty, the transmit ring is
+ * drained into the hardware FIFO via uart_start_tx.
  *
  */
 void uart_handle_interrupt(UNUSED trap_frame_t* tf) {
-    uchar_t c = mmio_read(RBR);
-    uart_putc(c);
-}
-
-// TEMP vprintf implementation
-// TODO: write console dev :)
-
-static inline void buf_putc(char c, void* buf) {
-    int* n = (int*)buf;
-
-    uart_putc(c);
-    (*n)++;
-}
+    // Reading the IIR acknowledges a pending THR-empty interrupt.
+    mmio_read(IIR);
 
-int vprintf(const char* format, va_list va) {
+    // Drain the hardware receive FIFO into the receive ring. If the ring is full, the
+    // oldest unread input is simply dropped.
+    bool received = false;
+    while ((mmio_read(LSR) & DR_MASK) != 0) {
+        uchar_t c = mmio_read(RBR);
+        if (rx_head - rx_tail < UART_RX_RING_SIZE) {
+            rx_ring[rx_head++ & (UART_RX_RING_SIZE - 1)] = c;
+            received = true;
+        }
+    }
+    if (received) softirq_raise(SOFTIRQ_UART_RX);
 
-    int n = 0;
-    __vprintf(format, va, buf_putc, &n);
-    return n;
+    // Refill the transmit FIFO from the transmit ring.
+    uart_tx_lock();
+    uart_start_tx();
+    uart_tx_unlock();
 }
@@ -0,0 +1,401 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/8/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        virtio.c
+//      Environment: Tiny OS
+//      Description: A driver for QEMU's virtio-blk device over the legacy MMIO transport.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <lib/stdint.h>
+#include <lib/stdbool.h>
+#include <lib/string.h>
+
+#include <debug.h>
+#include <riscv.h>
+
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+
+#include <trap/interrupt.h>
+#include <trap/softirq.h>
+
+#include <threads/spinlock.h>
+#include <threads/synch.h>
+
+#include <dev/virtio.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// VIRTIO-BLK                                                                                                          //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// QEMU's virt machine exposes virtio devices over the MMIO transport: a bank of control
+// registers at 0x10001000 (+ 0x1000 per slot) through which we negotiate features and
+// hand the device a *virtqueue* — a descriptor table plus two rings in guest memory:
+//
+//  - the driver places chains of buffer descriptors in the table and publishes the chain
+//    heads in the *avail* ring;
+//  - the device consumes chains and publishes completed heads in the *used* ring.
+//
+// A block request is a chain of three descriptors: the request header (type + sector),
+// the data buffer and a single device-written status byte.
+//
+// Crucially, the device only looks at the avail ring when the driver writes the
+// QueueNotify register — and under QEMU every such doorbell write is a VM exit. The
+// submission API is therefore split: virtio_blk_submit stages a request into the ring
+// *without* notifying, and virtio_blk_kick rings the doorbell once for the whole batch.
+//
+// See https://docs.oasis-open.org/virtio/virtio/v1.1/virtio-v1.1.html (we speak the
+// "legacy" interface, which is what QEMU's virt machine presents by default).
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define VIRTIO0_START           (0x10001000L)
+#define VIRTIO0_SIZE            (0x1000L)
+
+#define VIRTIO_MMIO_MAGIC_VALUE         (VIRTIO0_START + 0x000) // 0x74726976 ("virt")
+#define VIRTIO_MMIO_VERSION             (VIRTIO0_START + 0x004) // 1 (legacy)
+#define VIRTIO_MMIO_DEVICE_ID           (VIRTIO0_START + 0x008) // 2 => block device
+#define VIRTIO_MMIO_VENDOR_ID           (VIRTIO0_START + 0x00c)
+#define VIRTIO_MMIO_DEVICE_FEATURES     (VIRTIO0_START + 0x010)
+#define VIRTIO_MMIO_DRIVER_FEATURES     (VIRTIO0_START + 0x020)
+#define VIRTIO_MMIO_GUEST_PAGE_SIZE     (VIRTIO0_START + 0x028)
+#define VIRTIO_MMIO_QUEUE_SEL           (VIRTIO0_START + 0x030)
+#define VIRTIO_MMIO_QUEUE_NUM_MAX       (VIRTIO0_START + 0x034)
+#define VIRTIO_MMIO_QUEUE_NUM           (VIRTIO0_START + 0x038)
+#define VIRTIO_MMIO_QUEUE_ALIGN         (VIRTIO0_START + 0x03c)
+#define VIRTIO_MMIO_QUEUE_PFN           (VIRTIO0_START + 0x040)
+#define VIRTIO_MMIO_QUEUE_NOTIFY        (VIRTIO0_START + 0x050)
+#define VIRTIO_MMIO_INTERRUPT_STATUS    (VIRTIO0_START + 0x060)
+#define VIRTIO_MMIO_INTERRUPT_ACK       (VIRTIO0_START + 0x064)
+#define VIRTIO_MMIO_STATUS              (VIRTIO0_START + 0x070)
+
+#define mmio_read(reg)          (*(volatile uint32_t*)(reg))
+#define mmio_write(reg, v)      (*(volatile uint32_t*)(reg) = (v))
+
+// Device status bits.
+#define VIRTIO_STATUS_ACKNOWLEDGE       (1)
+#define VIRTIO_STATUS_DRIVER            (2)
+#define VIRTIO_STATUS_DRIVER_OK         (4)
+#define VIRTIO_STATUS_FEATURES_OK       (8)
+
+// Feature bits we refuse (we want the plain, synchronous-completion block device).
+#define VIRTIO_BLK_F_RO                 (1u << 5)
+#define VIRTIO_BLK_F_SCSI               (1u << 7)
+#define VIRTIO_BLK_F_CONFIG_WCE         (1u << 11)
+#define VIRTIO_BLK_F_MQ                 (1u << 12)
+#define VIRTIO_F_ANY_LAYOUT             (1u << 27)
+#define VIRTIO_F_RING_INDIRECT_DESC     (1u << 28)
+#define VIRTIO_F_RING_EVENT_IDX         (1u << 29)
+
+// Request types.
+#define VIRTIO_BLK_T_IN                 (0) // read
+#define VIRTIO_BLK_T_OUT                (1) // write
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// VIRTQUEUE                                                                                                           //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The number of descriptors in the ring. Must be a power of two. Each block request
+// uses a chain of three, so up to VIRTIO_RING_SIZE / 3 requests are in flight at once.
+#define VIRTIO_RING_SIZE        (32)
+
+#define VRING_DESC_F_NEXT       (1) // the chain continues via [next]
+#define VRING_DESC_F_WRITE      (2) // the *device* writes this buffer
+
+typedef struct {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} virtq_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[VIRTIO_RING_SIZE];
+} virtq_avail_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t len;
+} virtq_used_elem_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx;
+    virtq_used_elem_t ring[VIRTIO_RING_SIZE];
+} virtq_used_t;
+
+// The legacy MMIO layout: the descriptor table and avail ring share the first page(s),
+// and the used ring starts on the following page boundary.
+static virtq_desc_t* desc;
+static virtq_avail_t* avail;
+static virtq_used_t* used;
+
+// Descriptor allocation state and the staging counter, guarded by [ring_lock]. The
+// lock is a spinlock (not a sleeping lock) because the completion path runs in
+// softirq context.
+static spinlock_t ring_lock;
+static bool desc_free[VIRTIO_RING_SIZE];
+static uint16_t last_used_idx;
+
+// The number of requests staged in the avail ring since the last doorbell.
+static uint64_t staged;
+
+// Counts free *request slots* (descriptor triples); submitters sleep here when the
+// ring is full and completions release them.
+static semaphore_t free_slots;
+
+// The in-flight request published with head descriptor [i].
+static virtio_blk_req_t* inflight[VIRTIO_RING_SIZE];
+
+static bool present = false;
+
+bool virtio_blk_present(void) {
+    return present;
+}
+
+void virtio_blk_vm_init(void) {
+    kmap(VIRTIO0_START, VIRTIO0_START, PAGE_SIZE, PTE_R | PTE_W);
+    info("virtio: \t%#p -> %#p\n", VIRTIO0_START, VIRTIO0_START + VIRTIO0_SIZE);
+}
+
+/*
+ * Function:    alloc_desc
+ * -----------------------
+ * Allocates a free descriptor. The ring_lock must be held; the caller must have
+ * reserved a request slot via [free_slots], which guarantees a triple is free.
+ *
+ * @returns:    the index of the allocated descriptor.
+ */
+static uint16_t alloc_desc(void) {
+    for (uint16_t i = 0; i < VIRTIO_RING_SIZE; i++) {
+        if (desc_free[i]) {
+            desc_free[i] = false;
+            return i;
+        }
+    }
+    panic("virtio: descriptor ring exhausted despite slot reservation.\n");
+}
+
+static void free_desc(uint16_t i) {
+    assert(i < VIRTIO_RING_SIZE && !desc_free[i]);
+
+    desc[i].addr = 0;
+    desc_free[i] = true;
+}
+
+/*
+ * Procedure:   virtio_blk_submit
+ * ------------------------------
+ * This procedure stages [req] into the descriptor ring and publishes it in the avail
+ * ring — *without* notifying the device. Call virtio_blk_kick once a batch of requests
+ * has been staged; per-request doorbell writes are VM-exit-expensive under QEMU.
+ *
+ * If the ring is full, the procedure sleeps until a slot frees up, so it must not be
+ * called within the context of an interrupt handler.
+ *
+ * @virtio_blk_req_t* req:      the request. The caller fills sector/data/write.
+ *
+ */
+void virtio_blk_submit(virtio_blk_req_t* req) {
+    assert(present && req != null && req->data != null);
+
+    // Reserve a descriptor triple (sleeps while the ring is full).
+    semaphore_down(&free_slots);
+
+    req->hdr.type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    req->hdr.reserved = 0;
+    req->hdr.sector = req->sector;
+    req->status = 0xff;
+    semaphore_init(&req->done, 0);
+
+    intr_state_t state = spinlock_acquire(&ring_lock);
+
+    uint16_t d0 = alloc_desc();
+    uint16_t d1 = alloc_desc();
+    uint16_t d2 = alloc_desc();
+
+    desc[d0].addr = (uint64_t)&req->hdr;
+    desc[d0].len = sizeof(req->hdr);
+    desc[d0].flags = VRING_DESC_F_NEXT;
+    desc[d0].next = d1;
+
+    desc[d1].addr = (uint64_t)req->data;
+    desc[d1].len = BLK_SECTOR_SIZE;
+    desc[d1].flags = VRING_DESC_F_NEXT | (req->write ? 0 : VRING_DESC_F_WRITE);
+    desc[d1].next = d2;
+
+    desc[d2].addr = (uint64_t)&req->status;
+    desc[d2].len = 1;
+    desc[d2].flags = VRING_DESC_F_WRITE;
+    desc[d2].next = 0;
+
+    inflight[d0] = req;
+
+    // Publish the chain head. The barrier orders the descriptor writes before the
+    // avail index bump that makes them visible to the device.
+    avail->ring[avail->idx % VIRTIO_RING_SIZE] = d0;
+    __sync_synchronize();
+    avail->idx++;
+
+    staged++;
+
+    spinlock_release(&ring_lock, state);
+}
+
+/*
+ * Procedure:   virtio_blk_kick
+ * ----------------------------
+ * This procedure rings the device's doorbell — a single QueueNotify write covering
+ * every request staged since the last kick.
+ *
+ */
+void virtio_blk_kick(void) {
+    assert(present);
+
+    intr_state_t state = spinlock_acquire(&ring_lock);
+    if (staged != 0) {
+        staged = 0;
+        __sync_synchronize();
+        mmio_write(VIRTIO_MMIO_QUEUE_NOTIFY, 0);
+    }
+    spinlock_release(&ring_lock, state);
+}
+
+/*
+ * Procedure:   virtio_blk_wait
+ * ----------------------------
+ * This procedure sleeps until the device completes [req]; req->status then holds the
+ * device's verdict (zero on success).
+ *
+ * @virtio_blk_req_t* req:      a request previously staged with virtio_blk_submit.
+ *
+ */
+void virtio_blk_wait(virtio_blk_req_t* req) {
+    assert(req != null);
+
+    semaphore_down(&req->done);
+    if (req->status != 0) {
+        warn("virtio: request for sector %d failed (status %d).\n", req->sector, req->status);
+    }
+}
+
+void virtio_blk_rw(virtio_blk_req_t* req) {
+    virtio_blk_submit(req);
+    virtio_blk_kick();
+    virtio_blk_wait(req);
+}
+
+/*
+ * Procedure:   virtio_blk_softirq
+ * -------------------------------
+ * The soft half of the completion path: drains the used ring, releasing each completed
+ * request's descriptors and waking it's submitter.
+ *
+ */
+static void virtio_blk_softirq(void) {
+    intr_state_t state = spinlock_acquire(&ring_lock);
+
+    while (last_used_idx != used->idx) {
+        __sync_synchronize();
+        virtq_used_elem_t* elem = &used->ring[last_used_idx % VIRTIO_RING_SIZE];
+
+        uint16_t d0 = (uint16_t)elem->id;
+        virtio_blk_req_t* req = inflight[d0];
+        assert(req != null);
+        inflight[d0] = null;
+
+        free_desc(desc[desc[d0].next].next);
+        free_desc(desc[d0].next);
+        free_desc(d0);
+
+        last_used_idx++;
+
+        semaphore_up(&req->done);
+        semaphore_up(&free_slots);
+    }
+
+    spinlock_release(&ring_lock, state);
+}
+
+/*
+ * Procedure:   virtio_blk_handle_interrupt
+ * ----------------------------------------
+ * The hard half of the completion path: acknowledges the device's interrupt (which
+ * deasserts it's line) and defers the used-ring drain to virtio_blk_softirq.
+ *
+ */
+void virtio_blk_handle_interrupt(UNUSED trap_frame_t* tf) {
+    mmio_write(VIRTIO_MMIO_INTERRUPT_ACK, mmio_read(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3);
+    softirq_raise(SOFTIRQ_VIRTIO_BLK);
+}
+
+/*
+ * Procedure:   virtio_blk_init
+ * ----------------------------
+ * This procedure probes for a virtio-blk device in the first virtio-mmio slot and, if
+ * one is attached, negotiates features and hands the device it's virtqueue. If no
+ * device is attached (QEMU run without a -drive), the driver simply stays dormant.
+ *
+ */
+void virtio_blk_init(void) {
+    if (mmio_read(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976
+            || mmio_read(VIRTIO_MMIO_VERSION) != 1
+            || mmio_read(VIRTIO_MMIO_DEVICE_ID) != 2) {
+        info("virtio: no block device attached.\n");
+        return;
+    }
+
+    uint32_t status = 0;
+    mmio_write(VIRTIO_MMIO_STATUS, status);
+
+    status |= VIRTIO_STATUS_ACKNOWLEDGE;
+    mmio_write(VIRTIO_MMIO_STATUS, status);
+
+    status |= VIRTIO_STATUS_DRIVER;
+    mmio_write(VIRTIO_MMIO_STATUS, status);
+
+    // Negotiate features: take what the device offers, minus the ones we refuse.
+    uint32_t features = mmio_read(VIRTIO_MMIO_DEVICE_FEATURES);
+    features &= ~(VIRTIO_BLK_F_RO | VIRTIO_BLK_F_SCSI | VIRTIO_BLK_F_CONFIG_WCE
+                | VIRTIO_BLK_F_MQ | VIRTIO_F_ANY_LAYOUT
+                | VIRTIO_F_RING_INDIRECT_DESC | VIRTIO_F_RING_EVENT_IDX);
+    mmio_write(VIRTIO_MMIO_DRIVER_FEATURES, features);
+
+    status |= VIRTIO_STATUS_FEATURES_OK;
+    mmio_write(VIRTIO_MMIO_STATUS, status);
+
+    // Queue 0 setup: the legacy transport takes the queue as a page frame number, with
+    // the descriptor table + avail ring in the first page and the used ring starting
+    // on the next page boundary.
+    mmio_write(VIRTIO_MMIO_QUEUE_SEL, 0);
+    uint32_t max = mmio_read(VIRTIO_MMIO_QUEUE_NUM_MAX);
+    assert(max != 0 && max >= VIRTIO_RING_SIZE);
+    mmio_write(VIRTIO_MMIO_QUEUE_NUM, VIRTIO_RING_SIZE);
+
+    // The ring lives in the DMA zone: the device addresses it physically, and the
+    // zone keeps contiguous low blocks free of general allocation churn.
+    void* queue = alloc_pages_zone(ZONE_DMA, 1);
+    assert(queue != null);
+    bzero(queue, 2 * PAGE_SIZE);
+
+    desc = (virtq_desc_t*)queue;
+    avail = (virtq_avail_t*)((uint8_t*)queue + VIRTIO_RING_SIZE * sizeof(virtq_desc_t));
+    used = (virtq_used_t*)((uint8_t*)queue + PAGE_SIZE);
+
+    mmio_write(VIRTIO_MMIO_GUEST_PAGE_SIZE, PAGE_SIZE);
+    mmio_write(VIRTIO_MMIO_QUEUE_ALIGN, PAGE_SIZE);
+    mmio_write(VIRTIO_MMIO_QUEUE_PFN, (uint64_t)queue >> PAGE_SHIFT);
+
+    spinlock_init(&ring_lock);
+    semaphore_init(&free_slots, VIRTIO_RING_SIZE / 3);
+    for (uint16_t i = 0; i < VIRTIO_RING_SIZE; i++) desc_free[i] = true;
+    last_used_idx = 0;
+
+    softirq_register(SOFTIRQ_VIRTIO_BLK, virtio_blk_softirq);
+
+    status |= VIRTIO_STATUS_DRIVER_OK;
+    mmio_write(VIRTIO_MMIO_STATUS, status);
+
+    present = true;
+    info("virtio: block device initialized (%d descriptors).\n", VIRTIO_RING_SIZE);
+}
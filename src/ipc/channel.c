@@ -0,0 +1,143 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        channel.c
+//      Environment: Tiny OS
+//      Description: Zero-copy IPC channels. A sender donates (move) or shares whole pages to the
+//                   channel; the receiver maps the very same frames into it's own address space.
+//                   No payload byte is ever copied — a message costs a few pte writes and a
+//                   targeted fence, independent of it's size.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// Move semantics (channel_send): the pages are unmapped from the sender, so it gives up
+// all access — the frames survive the unmap because the message holds a reference (see
+// the per-frame reference counts in pmm.c) and the receiver maps them writable.
+//
+// Share semantics (channel_send_shared): the sender keeps the pages, but they are
+// write-protected and tagged PTE_COW in *both* address spaces — a later write by
+// either side is resolved with a private copy by the ordinary COW fault path, so
+// neither side can scribble over the other.
+//
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <lib/stdint.h>
+#include <lib/stdbool.h>
+
+#include <debug.h>
+
+#include <mm/pmm.h>
+#include <mm/vmm.h>
+
+#include <threads/thread.h>
+#include <threads/synch.h>
+
+#include <ipc/channel.h>
+
+
+void channel_init(channel_t* ch) {
+    lock_init(&ch->lock);
+    cond_init(&ch->can_send);
+    cond_init(&ch->can_recv);
+
+    ch->head = ch->tail = ch->count = 0;
+}
+
+/*
+ * Procedure:   __channel_send
+ * ---------------------------
+ * The common send half: collects the frames backing [vaddr, vaddr + length) from
+ * the sender's page table, takes a reference on each, and queues them (blocking
+ * while the ring is full). The [move] flag selects donation — the sender's
+ * mappings are removed — over sharing, where they are downgraded to read-only.
+ *
+ * @channel_t* ch:      The channel.
+ * @vaddr_t vaddr:      The page-aligned start of the payload in the sender's
+ *                      address space.
+ * @size_t length:      The payload length in bytes.
+ * @bool move:          Donate the pages rather than share them.
+ *
+ */
+static void __channel_send(channel_t* ch, vaddr_t vaddr, size_t length, bool move) {
+    assert(PAGE_OFFSET(vaddr) == 0);
+    assert(length > 0);
+
+    size_t npages = PAGE_ROUND_UP(length) >> PAGE_SHIFT;
+    assert(npages <= CHANNEL_MSG_PAGES_MAX);
+
+    pagetable_t table = proc_current()->pagetable;
+
+    lock_acquire(&ch->lock);
+    while (ch->count == CHANNEL_RING_SIZE) cond_wait(&ch->can_send, &ch->lock);
+
+    channel_msg_t* msg = &ch->ring[ch->head];
+    ch->head = (ch->head + 1) % CHANNEL_RING_SIZE;
+    ch->count++;
+
+    msg->npages = npages;
+    msg->length = length;
+    msg->perm = move ? (PTE_R | PTE_W | PTE_U) : (PTE_R | PTE_U | PTE_COW);
+
+    for (size_t i = 0; i < npages; i++) {
+        vaddr_t va = vaddr + i * PAGE_SIZE;
+
+        // The message holds a reference to the frame, so a donation survives the
+        // sender's unmap below (which drops the sender's own reference).
+        msg->pages[i] = walk(table, va);
+        page_ref_inc((void*)msg->pages[i]);
+
+        if (!move) uvm_write_protect(table, va);
+    }
+
+    // For a donation, remove the sender's mappings entirely: the sender must not
+    // retain a window onto pages the receiver now owns.
+    if (move) unmap(table, vaddr, npages * PAGE_SIZE);
+
+    cond_signal(&ch->can_recv);
+    lock_release(&ch->lock);
+}
+
+void channel_send(channel_t* ch, vaddr_t vaddr, size_t length) {
+    __channel_send(ch, vaddr, length, true);
+}
+
+void channel_send_shared(channel_t* ch, vaddr_t vaddr, size_t length) {
+    __channel_send(ch, vaddr, length, false);
+}
+
+/*
+ * Function:    channel_recv
+ * -------------------------
+ * Receives the next message (blocking while the channel is empty), mapping it's
+ * frames at [vaddr] in the caller's address space. Donated pages arrive writable
+ * and are owned by the receiver; shared pages arrive read-only and copy-on-write.
+ *
+ * @channel_t* ch:      The channel.
+ * @vaddr_t vaddr:      The page-aligned destination in the receiver's address
+ *                      space (an unmapped range of at least the message's size).
+ *
+ * @returns:            the payload length in bytes.
+ *
+ */
+size_t channel_recv(channel_t* ch, vaddr_t vaddr) {
+    assert(PAGE_OFFSET(vaddr) == 0);
+
+    pagetable_t table = proc_current()->pagetable;
+
+    lock_acquire(&ch->lock);
+    while (ch->count == 0) cond_wait(&ch->can_recv, &ch->lock);
+
+    channel_msg_t* msg = &ch->ring[ch->tail];
+    ch->tail = (ch->tail + 1) % CHANNEL_RING_SIZE;
+    ch->count--;
+
+    for (size_t i = 0; i < msg->npages; i++) {
+        map(table, vaddr + i * PAGE_SIZE, msg->pages[i], PAGE_SIZE, msg->perm);
+    }
+
+    size_t length = msg->length;
+
+    cond_signal(&ch->can_send);
+    lock_release(&ch->lock);
+
+    return length;
+}
@@ -0,0 +1,167 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/12/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        htable.c
+//      Environment: Tiny OS
+//      Description:
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <lib/stdbool.h>
+#include <lib/string.h>
+
+#include <debug.h>
+
+#include <mm/pmm.h>
+
+#include <lib/htable.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CHAINED HASH TABLES
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Each bucket is the head of a singly linked chain threaded through the embedded nodes, so — as with
+// list.h and pheap.h — the table itself never allocates per element. The bucket array is the only
+// allocation: it starts as a small array embedded in htable_t (so tables used during early boot work
+// before the PMM is up) and doubles via alloc_pages once the load factor (chains of two, on average)
+// is exceeded. A failed grow is not an error — the table just carries on with longer chains.
+//
+// The table is not synchronized; callers guard it with whatever lock guards the owning structure.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+static inline size_t __htable_bucket(htable_t* ht, uint64_t key) {
+    return ht->hash(key) & (ht->num_buckets - 1);
+}
+
+/*
+ * Procedure:   __htable_grow
+ * --------------------------
+ * This procedure doubles the bucket array (the first grow jumps from the embedded
+ * array straight to a page — 512 buckets) and rehashes every chain into it. If the
+ * allocation fails we simply keep the old array; the table still works, just with
+ * longer chains.
+ *
+ */
+static void __htable_grow(htable_t* ht) {
+    bool embedded = ht->buckets == ht->static_buckets;
+
+    size_t new_order = embedded ? 0 : ht->order + 1;
+    size_t new_num_buckets = (PAGE_SIZE << new_order) / sizeof(htable_node_t*);
+
+    htable_node_t** new_buckets = alloc_pages(new_order);
+    if (new_buckets == null) return;
+
+    memset(new_buckets, 0, PAGE_SIZE << new_order);
+
+    // Rehash every chain into the new array.
+    size_t old_num_buckets = ht->num_buckets;
+    htable_node_t** old_buckets = ht->buckets;
+
+    ht->buckets = new_buckets;
+    ht->num_buckets = new_num_buckets;
+
+    for (size_t i = 0; i < old_num_buckets; i++) {
+        htable_node_t* n = old_buckets[i];
+        while (n != null) {
+            htable_node_t* next = n->next;
+
+            size_t b = __htable_bucket(ht, ht->key_of(n));
+            n->next = ht->buckets[b];
+            ht->buckets[b] = n;
+
+            n = next;
+        }
+    }
+
+    if (!embedded) free_pages(old_buckets, ht->order);
+    ht->order = new_order;
+}
+
+/*
+ * Procedure:   htable_init
+ * ------------------------
+ * This procedure initializes the table [ht] as empty, keyed by [key_of] and hashed
+ * by [hash]. No allocation occurs (the embedded bucket array is used until the
+ * table outgrows it), so this is safe before the PMM is initialized.
+ *
+ */
+void htable_init(htable_t* ht, htable_key_t key_of, htable_hash_t hash) {
+    assert(ht != null && key_of != null && hash != null);
+
+    ht->buckets = ht->static_buckets;
+    ht->num_buckets = HTABLE_INIT_BUCKETS;
+    ht->size = 0;
+    ht->order = 0;
+
+    ht->key_of = key_of;
+    ht->hash = hash;
+
+    for (size_t i = 0; i < HTABLE_INIT_BUCKETS; i++) ht->static_buckets[i] = null;
+}
+
+/*
+ * Procedure:   htable_insert
+ * --------------------------
+ * This procedure inserts the node [x] into the table in O(1) (plus the occasional
+ * amortized rehash). Duplicate keys are permitted but discouraged: htable_find
+ * returns an arbitrary one.
+ *
+ * @htable_node_t* x:   The node to be inserted. Must not already be in a table.
+ *
+ */
+void htable_insert(htable_t* ht, htable_node_t* x) {
+    assert(ht != null && x != null);
+
+    // Keep the average chain at two nodes or shorter.
+    if (ht->size > 2 * ht->num_buckets) __htable_grow(ht);
+
+    size_t b = __htable_bucket(ht, ht->key_of(x));
+    x->next = ht->buckets[b];
+    ht->buckets[b] = x;
+
+    ht->size++;
+}
+
+/*
+ * Procedure:   htable_delete
+ * --------------------------
+ * This procedure deletes the node [x] from the table (an O(1) expected chain walk).
+ *
+ * @htable_node_t* x:   The node to be deleted. Must be in [ht].
+ *
+ */
+void htable_delete(htable_t* ht, htable_node_t* x) {
+    assert(ht != null && x != null && ht->size != 0);
+
+    size_t b = __htable_bucket(ht, ht->key_of(x));
+
+    htable_node_t** pn = &ht->buckets[b];
+    while (*pn != x) {
+        assert(*pn != null);
+        pn = &(*pn)->next;
+    }
+
+    *pn = x->next;
+    x->next = null;
+
+    ht->size--;
+}
+
+/*
+ * Function:    htable_find
+ * ------------------------
+ * This function returns the node with key [key], or null if no such node is in
+ * the table (an O(1) expected chain walk).
+ *
+ */
+htable_node_t* htable_find(htable_t* ht, uint64_t key) {
+    assert(ht != null);
+
+    htable_node_t* n = ht->buckets[__htable_bucket(ht, key)];
+    while (n != null && ht->key_of(n) != key) n = n->next;
+
+    return n;
+}
+
+inline size_t htable_size(htable_t* ht) {
+    return ht->size;
+}
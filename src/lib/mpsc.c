@@ -0,0 +1,96 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/5/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        mpsc.c
+//      Environment: Tiny OS
+//      Description: A lock-free multi-producer single-consumer intrusive queue.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <debug.h>
+
+#include <lib/mpsc.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MPSC QUEUES
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Our list_t requires external mutual exclusion, which forces interrupt handlers that
+// want to hand work to a thread to disable interrupts (or spin) around every operation.
+// The mpsc queue avoids this with the A-extension atomics: producers push with a
+// compare-and-swap loop and the consumer detaches the whole chain with a single
+// exchange, so neither side ever blocks the other.
+//
+// Pushes build a lifo chain:
+//
+//      head -> [c] -> [b] -> [a] -> null
+//
+// and mpsc_drain reverses the detached chain so the consumer sees a, b, c — i.e.
+// fifo order. The reversal is O(n), but it's paid once per *batch* by the consumer
+// (in thread context), never by a producer in interrupt context.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void mpsc_init(mpsc_queue_t* q) {
+    assert(q != null);
+
+    q->head = null;
+}
+
+bool mpsc_empty(mpsc_queue_t* q) {
+    assert(q != null);
+
+    return q->head == null;
+}
+
+/*
+ * Function:    mpsc_push
+ * ----------------------
+ * This function pushes [node] onto [q] using a compare-and-swap loop. It is safe to
+ * call from any context — including interrupt handlers — on any hart, concurrently
+ * with other producers and with the consumer.
+ *
+ * @mpsc_queue_t* q:        the queue.
+ * @mpsc_node_t* node:      the node that is to be pushed. Must not already be on a queue.
+ *
+ * @returns:                true iff the queue was empty before the push. Producers
+ *                          typically use this to decide whether the consumer needs
+ *                          waking.
+ */
+bool mpsc_push(mpsc_queue_t* q, mpsc_node_t* node) {
+    assert(q != null && node != null);
+
+    mpsc_node_t* head;
+    do {
+        head = q->head;
+        node->next = head;
+    } while (!__sync_bool_compare_and_swap(&q->head, head, node));
+
+    return head == null;
+}
+
+/*
+ * Function:    mpsc_drain
+ * -----------------------
+ * This function detaches *every* node currently on [q] with a single atomic exchange
+ * and returns them as a null-terminated chain in fifo (push) order. Only the single
+ * consumer may call this.
+ *
+ * @mpsc_queue_t* q:        the queue.
+ *
+ * @returns:                the head of the detached chain (walk it via node->next),
+ *                          or null if the queue was empty.
+ */
+mpsc_node_t* mpsc_drain(mpsc_queue_t* q) {
+    assert(q != null);
+
+    mpsc_node_t* chain = __sync_lock_test_and_set(&q->head, null);
+
+    // Reverse the lifo chain so the consumer processes nodes in push order.
+    mpsc_node_t* fifo = null;
+    while (chain != null) {
+        mpsc_node_t* next = chain->next;
+        chain->next = fifo;
+        fifo = chain;
+        chain = next;
+    }
+
+    return fifo;
+}
@@ -0,0 +1,250 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/10/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        pheap.c
+//      Environment: Tiny OS
+//      Description:
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <debug.h>
+
+#include <lib/pheap.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PAIRING HEAPS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The pairing heap is the laziest of the mergeable heaps: every operation reduces to "meld", which
+// makes the smaller of two roots the parent of the other in O(1). Insert melds a singleton with the
+// root, merge melds two roots — all the real work is deferred to extract-min, which melds the
+// orphaned children back together with the classic two-pass pairing scheme (left-to-right in pairs,
+// then right-to-left), giving the amortized O(log n) bound.
+//
+// For example, melding the heaps rooted at 2 and 5 hangs 5 off 2 as it's leftmost child:
+//
+//        +---+    +---+          +---+
+//        | 2 |    | 5 |    =>    | 2 |
+//        +---+    +---+          +---+
+//          |        |            /   \
+//          7        9           5     7
+//                               |
+//                               9
+//
+// As with list.h, no dynamic memory allocation is required: the three pointers per node live in the
+// owning struct. Both passes of the pairing scheme are iterative (the obvious recursive version has
+// O(n) stack depth — not a good look on a one-page kernel stack).
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+
+/*
+ * Function:    __pheap_meld
+ * -------------------------
+ * This function melds two heap roots [a] and [b]: the one that orders first becomes
+ * the parent, the other it's leftmost child. The winner's [sibling] and [prev] are
+ * left untouched (the caller owns them).
+ *
+ * @returns:    The root of the melded heap.
+ *
+ */
+static pheap_node_t* __pheap_meld(pheap_less_t less, pheap_node_t* a, pheap_node_t* b) {
+    if (less(b, a)) {
+        pheap_node_t* tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    // [b] becomes the leftmost child of [a].
+    b->sibling = a->child;
+    if (a->child != null) a->child->prev = b;
+    b->prev = a;
+    a->child = b;
+
+    return a;
+}
+
+/*
+ * Function:    __pheap_merge_pairs
+ * --------------------------------
+ * This function melds a sibling list (the orphaned children of a removed node) into
+ * a single heap with the two-pass pairing scheme. The first pass melds adjacent
+ * pairs left to right, chaining the winners through their (now unused) [prev]
+ * pointers; the second pass melds the winners right to left.
+ *
+ * @returns:    The root of the merged heap, or null for an empty sibling list.
+ *
+ */
+static pheap_node_t* __pheap_merge_pairs(pheap_less_t less, pheap_node_t* n) {
+    // First pass: meld adjacent pairs, left to right.
+    pheap_node_t* winners = null;
+    while (n != null) {
+        pheap_node_t* a = n;
+        pheap_node_t* b = a->sibling;
+
+        if (b != null) {
+            n = b->sibling;
+            a->sibling = null;
+            b->sibling = null;
+            a = __pheap_meld(less, a, b);
+        } else {
+            n = null;
+            a->sibling = null;
+        }
+
+        a->prev = winners;
+        winners = a;
+    }
+
+    // Second pass: meld the winners, right to left (the chain built above is
+    // already reversed).
+    pheap_node_t* root = null;
+    while (winners != null) {
+        pheap_node_t* a = winners;
+        winners = winners->prev;
+
+        root = root == null ? a : __pheap_meld(less, root, a);
+    }
+
+    return root;
+}
+
+/*
+ * Procedure:   pheap_init
+ * -----------------------
+ * This procedure initializes the heap [heap] as empty, ordered by [less].
+ *
+ */
+void pheap_init(pheap_t* heap, pheap_less_t less) {
+    assert(heap != null && less != null);
+
+    heap->root = null;
+    heap->size = 0;
+    heap->less = less;
+}
+
+/*
+ * Procedure:   pheap_push
+ * -----------------------
+ * This procedure inserts the node [x] into the heap in O(1) (a singleton meld).
+ *
+ * @pheap_node_t* x:    The node to be inserted. Must not already be in a heap.
+ *
+ */
+void pheap_push(pheap_t* heap, pheap_node_t* x) {
+    assert(heap != null && x != null);
+
+    x->child = null;
+    x->sibling = null;
+    x->prev = null;
+
+    heap->root = heap->root == null ? x : __pheap_meld(heap->less, heap->root, x);
+    heap->size++;
+}
+
+/*
+ * Function:    pheap_peek
+ * -----------------------
+ * This function returns the minimum node of the heap (the root) without removing
+ * it, or null if the heap is empty.
+ *
+ */
+pheap_node_t* pheap_peek(pheap_t* heap) {
+    assert(heap != null);
+    return heap->root;
+}
+
+/*
+ * Function:    pheap_pop
+ * ----------------------
+ * This function removes and returns the minimum node of the heap, melding the
+ * root's orphaned children back together (amortized O(log n)).
+ *
+ * As with list_delete, it is not safe to treat [x] as an element of the heap
+ * after popping it.
+ *
+ */
+pheap_node_t* pheap_pop(pheap_t* heap) {
+    assert(heap != null && heap->size != 0);
+
+    pheap_node_t* min = heap->root;
+
+    heap->root = __pheap_merge_pairs(heap->less, min->child);
+    if (heap->root != null) {
+        heap->root->prev = null;
+        heap->root->sibling = null;
+    }
+
+    heap->size--;
+
+    min->child = null;
+    min->sibling = null;
+    min->prev = null;
+
+    return min;
+}
+
+/*
+ * Procedure:   pheap_delete
+ * -------------------------
+ * This procedure deletes an arbitrary node [x] from the heap: [x] is unlinked from
+ * it's sibling list (this is what the [prev] pointers buy us) and it's children are
+ * melded back into the heap.
+ *
+ * @pheap_node_t* x:    The node to be deleted. Must be in [heap].
+ *
+ */
+void pheap_delete(pheap_t* heap, pheap_node_t* x) {
+    assert(heap != null && x != null && heap->size != 0);
+
+    if (x == heap->root) {
+        pheap_pop(heap);
+        return;
+    }
+
+    // Unlink [x]: [x->prev] is either x's left sibling, or x's parent if x is a
+    // leftmost child.
+    if (x->prev->child == x) {
+        x->prev->child = x->sibling;
+    } else {
+        x->prev->sibling = x->sibling;
+    }
+    if (x->sibling != null) x->sibling->prev = x->prev;
+
+    // Meld x's orphaned children back into the heap.
+    pheap_node_t* sub = __pheap_merge_pairs(heap->less, x->child);
+    if (sub != null) {
+        sub->sibling = null;
+        heap->root = __pheap_meld(heap->less, heap->root, sub);
+        heap->root->prev = null;
+    }
+
+    heap->size--;
+
+    x->child = null;
+    x->sibling = null;
+    x->prev = null;
+}
+
+/*
+ * Procedure:   pheap_merge
+ * ------------------------
+ * This procedure merges [other] into [heap] in O(1), leaving [other] empty.
+ * The two heaps must share the same ordering.
+ *
+ */
+void pheap_merge(pheap_t* heap, pheap_t* other) {
+    assert(heap != null && other != null);
+    assert(heap->less == other->less);
+
+    if (other->root != null) {
+        heap->root = heap->root == null
+                ? other->root
+                : __pheap_meld(heap->less, heap->root, other->root);
+        heap->size += other->size;
+    }
+
+    other->root = null;
+    other->size = 0;
+}
+
+inline size_t pheap_size(pheap_t* heap) {
+    return heap->size;
+}
@@ -99,21 +99,27 @@ typedef struct {
 } buf_t;
 
 /*
- * Procedure:   buf_putc
+ * Procedure:   buf_putn
  * ---------------------
- * This inline procedure appends character [c] to the buffer with pointer [p]
- * provided length < max_length.
+ * This inline procedure appends the [n] characters at [s] to the buffer with
+ * pointer [p], truncating at max_length (the length still counts the full [n],
+ * matching snprintf's return value semantics).
  *
- * @char  c:        The character to be appended.
+ * @const char* s:  The characters to be appended.
+ * @size_t n:       The number of characters.
  * @void* p:        The pointer to the buffer.
  *
  */
-static inline void buf_putc(char c, void* p) {
+static inline void buf_putn(const char* s, size_t n, void* p) {
     buf_t* buf = (buf_t*)p;
 
-    if (buf->length++ < buf->max_length) {
-        *(buf->buffer++) = c;
+    if (buf->length < buf->max_length) {
+        size_t m = MIN(n, buf->max_length - buf->length);
+        memcpy(buf->buffer, s, m);
+        buf->buffer += m;
     }
+
+    buf->length += n;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -147,7 +153,7 @@ int vsnprintf(char* buffer, size_t n, const char* format, va_list va) {
     buf.length = 0;
     buf.max_length = n > 0 ? n - 1 : 0;
 
-    __vprintf(format, va, buf_putc, &buf);
+    __vprintf(format, va, buf_putn, &buf);
 
     if (n > 0) *buf.buffer = '\0';
 
@@ -364,46 +370,75 @@ static const char* parse_format(const char* format, format_t* f, va_list* va) {
 /*
  * Procedure:   nputc
  * ------------------
- * Calls putc on [c] and [buf], [n] times. Used for padding.
+ * Writes the character [c] to the buffer [buf], [n] times. Used for padding; the
+ * repeats are emitted in chunks so the sink still sees block writes.
  *
  * @char c:                     The character that is written to the buffer [buf].
  * @int  n:                     The number of times the character is written to the buffer [buf].
- * @void (*putc)(char, void*):  The pointer to a putc method.
+ * @putn:                       The pointer to a block write method.
  * @void* buf:                  The pointer to a buffer.
  *
  */
-static void inline nputc(char c, int n, void (*putc)(char, void*), void* buf) {
-    while (n-- > 0) {
-        putc(c, buf);
+static void inline nputc(char c, int n, void (*putn)(const char*, size_t, void*), void* buf) {
+    char chunk[16];
+
+    for (size_t i = 0; i < sizeof(chunk); i++) chunk[i] = c;
+
+    while (n > 0) {
+        int m = MIN(n, (int)sizeof(chunk));
+        putn(chunk, m, buf);
+        n -= m;
     }
 }
 
+// Two digits per divide: the decimal conversion below pulls digit *pairs* out of
+// this table, halving the number of (slow) divides per conversion.
+static const char digit_pairs[200] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
 /*
  * Procedure:   ntoa
  * -----------------
- * Performs an integer conversion, writing to [buf] using the [putc] method.
+ * Performs an integer conversion, writing to [buf] using the [putn] method.
  * The integer converted has an absolute value [value]. If [is_signed] is true,
  * then a signed conversion with [negative] indiciating whether the value was
  * negative is performed. Otherwise the procedure does an unsigned conversion
  * and ignored [negative].
  * The conversion is done according to the base [b] provided.
  *
+ * The digits are generated *backwards* from the end of a local buffer (so the
+ * converted run is already in output order and goes to the sink as one block),
+ * with a per-base fast path: decimal takes two digits per divide via the
+ * digit_pairs table, hex and octal are pure shift/mask — no divides at all.
+ *
  * @uintmax_t value:            The absolute value of the integer to be converted.
  * @bool is_signed:             Indicates whether the value is unsigned or signed.
  * @bool negative:              Indicates whether the value is negative.
  * @base_t* b:                  Pointer to the base representation of the integer.
  *                              See constants BASE_D, BASE_O, BASE_x, and  BASE_X.
- * @void (*putc)(char, void*):  The pointer to a putc method.
+ * @putn:                       The pointer to a block write method.
  * @void* buf:                  The pointer to a buffer.
  *
  */
 static void ntoa(
         uintmax_t value, bool is_signed, bool negative,
         const base_t* b, const format_t* f,
-        void (*putc)(char, void*), void* buf
+        void (*putn)(const char*, size_t, void*), void* buf
         ) {
-    // Buffer and current position
-    char buffer[NTOA_BUFFER_SIZE], *pos;
+    // Digits are generated downward from the end of the buffer, so [pos] walks
+    // backwards and the run [pos, end) is in output order.
+    char buffer[NTOA_BUFFER_SIZE];
+    char* end = &buffer[NTOA_BUFFER_SIZE];
+    char* pos = end;
 
     // The so-called 'x' character to use (or 0 if none)
     char x;
@@ -412,9 +447,8 @@ static void ntoa(
     char sign;
     int precision;
 
-    // The # of pad and digit characters
+    // The # of pad characters
     int pad_len;
-    int digit_len;
 
     // Determine the sign character to use (or 0 if none).
     sign = 0;
@@ -428,50 +462,78 @@ static void ntoa(
     // Only included with a hexadecimal conversion of non-zero value with the hash flag
     x = (f->flags & HASH) && value ? b->x : 0;
 
-    // We push digits into a buffer. Note that these digits will be in reverse order,
-    // so we must later output the buffer's content in reverse :)
-    pos = &buffer[0]; digit_len = 0;
-
-    while ((value > 0) && (pos - buffer < NTOA_BUFFER_SIZE)) {
-        *pos++ = b->digits[value % b->base];
-        value /= b->base;
-        digit_len++;
+    // Generate the digits (none for a value of zero — the precision below renders
+    // it, matching the old behavior).
+    switch (b->base) {
+        case 10:
+            while (value >= 100) {
+                const char* pair = &digit_pairs[(value % 100) * 2];
+                value /= 100;
+                *--pos = pair[1];
+                *--pos = pair[0];
+            }
+            if (value >= 10) {
+                const char* pair = &digit_pairs[value * 2];
+                *--pos = pair[1];
+                *--pos = pair[0];
+            } else if (value > 0) {
+                *--pos = (char)('0' + value);
+            }
+            break;
+        case 16:
+            while (value > 0) {
+                *--pos = b->digits[value & 0xf];
+                value >>= 4;
+            }
+            break;
+        case 8:
+            while (value > 0) {
+                *--pos = b->digits[value & 0x7];
+                value >>= 3;
+            }
+            break;
+        default:
+            while (value > 0 && pos > buffer) {
+                *--pos = b->digits[value % b->base];
+                value /= b->base;
+            }
+            break;
     }
 
-    // We now append zeros to match precision.
+    // We now prepend zeros to match precision.
     // If the precision is 0, then a value of zero is an empty string, otherwise as 0.
     precision = f->precision < 0 ? 1 : f->precision;
-    while ((pos - buffer < precision) && (pos - buffer < NTOA_BUFFER_SIZE)) *pos++ = '0';
+    while ((end - pos < precision) && (pos > buffer)) *--pos = '0';
 
     // If the # flag is used with octal, the result must always begin with a zero
-    if ((f->flags & HASH) && (b->base == 8) && (pos == buffer || pos[-1] != '0')) *pos++ = '0';
+    if ((f->flags & HASH) && (b->base == 8) && (pos == end || *pos != '0')) *--pos = '0';
 
     // Calculate the number of pad characters required
-    pad_len = MAX(f->width - (pos - buffer) - (x ? 2 : 0) - (sign != 0), 0);
+    pad_len = MAX(f->width - (int)(end - pos) - (x ? 2 : 0) - (sign != 0), 0);
 
 
     // Now we begin outputting the integer :)
 
     // If we don't have left-justify or zero pad, then pad with whitespace :)
-    if ((f->flags & (LEFT | ZERO)) == 0)    nputc(' ', pad_len, putc, buf);
+    if ((f->flags & (LEFT | ZERO)) == 0)    nputc(' ', pad_len, putn, buf);
 
     // If sign != 0, then output the sign
-    if (sign)                               putc(sign, buf);
+    if (sign)                               putn(&sign, 1, buf);
 
     // If x != 0 => contains 'x' character (either x or X). So we must output 0x or 0X.
     if (x) {
-        putc('0', buf);
-        putc(x, buf);
+        char prefix[2] = { '0', x };
+        putn(prefix, 2, buf);
     }
 
     // If we have a zero flag, then we pad :)
-    if (f->flags & ZERO)                    nputc('0', pad_len, putc, buf);
+    if (f->flags & ZERO)                    nputc('0', pad_len, putn, buf);
 
-    // Reverse output the buffer (from current pos to &buffer[0])
-    while (pos > buffer)                    putc(*--pos, buf);
+    // The converted run, in one block :)
+    putn(pos, end - pos, buf);
 
     // If we have a left-justify, then pad the right side
-    if (f->flags & LEFT)                    nputc(' ', pad_len, putc, buf);
+    if (f->flags & LEFT)                    nputc(' ', pad_len, putn, buf);
 }
 
 /*
@@ -479,45 +541,48 @@ static void ntoa(
  * -------------------
  * Formats [n] characters of the string with pointer [str]
  * according to the format [f]. The converted output is written to [buf]
- * using the [putc] method.
+ * using the [putn] method (the string body as a single block).
  *
  * @char* str:                  Pointer to the start of the string to be converted.
  * @int n:                      The length of the string [str].
- * @void (*putc)(char, void*):  The pointer to a putc method.
+ * @putn:                       The pointer to a block write method.
  * @void* buf:                  The pointer to a buffer.
  *
  */
-static void string(const char* str, int n, format_t* f, void (*putc)(char, void*), void* buf) {
+static void string(const char* str, int n, format_t* f, void (*putn)(const char*, size_t, void*), void* buf) {
 
-    if ((f->width > n) && (f->flags & LEFT) == 0)          nputc(' ', f->width - n, putc, buf);
+    if ((f->width > n) && (f->flags & LEFT) == 0)          nputc(' ', f->width - n, putn, buf);
 
-    for (int i = 0; i < n; i++)                            putc(str[i], buf);
+    putn(str, n, buf);
 
-    if ((f->width > n) && (f->flags & LEFT) != 0)          nputc(' ', f->width - n, putc, buf);
+    if ((f->width > n) && (f->flags & LEFT) != 0)          nputc(' ', f->width - n, putn, buf);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Internal __printf and __vprintf implementations                                                                    //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-void __printf(const char* format, void (*putc)(char, void*), void* buf, ...) {
+void __printf(const char* format, void (*putn)(const char* s, size_t n, void* buf), void* buf, ...) {
     va_list va;
 
     va_start(va, buf);
-    __vprintf(format, va, putc, buf);
+    __vprintf(format, va, putn, buf);
     va_end(va);
 
 }
 
-void __vprintf(const char* format, va_list va, void (*putc)(char, void*), void* buf) {
+void __vprintf(const char* format, va_list va, void (*putn)(const char* s, size_t n, void* buf), void* buf) {
 
-    for (; *format != '\0'; format++) {
+    while (*format != '\0') {
         format_t f;
 
         // Is [*format] the beginning of a format prototype?
         if (*format != '%') {
-            // no
-            putc(*format, buf);
+            // no — emit the whole literal run up to the next prototype (or the end)
+            // as a single block.
+            const char* run = format;
+            while (*format != '\0' && *format != '%') format++;
+            putn(run, format - run, buf);
             continue;
         }
         // yes :)
@@ -559,7 +624,7 @@ void __vprintf(const char* format, va_list va, void (*putc)(char, void*), void*
                 }
 
                 uintmax_t abs_x = abs(x);
-                ntoa(abs_x, true, x < 0, &BASE_D, &f, putc, buf);
+                ntoa(abs_x, true, x < 0, &BASE_D, &f, putn, buf);
 
                 break;
             }
@@ -607,12 +672,12 @@ void __vprintf(const char* format, va_list va, void (*putc)(char, void*), void*
                     default: NOT_REACHABLE;
                 }
 
-                ntoa(x, false, false, b, &f, putc, buf);
+                ntoa(x, false, false, b, &f, putn, buf);
                 break;
             }
             case 'c': {
                 char c = (char)va_arg(va, int);
-                string(&c, 1, &f, putc, buf);
+                string(&c, 1, &f, putn, buf);
                 break;
             }
             case 's': {
@@ -622,13 +687,13 @@ void __vprintf(const char* format, va_list va, void (*putc)(char, void*), void*
                 // Some bit magic here. If f.precision = -1,
                 // then when we cast to size_t (an uint64_t)
                 // then we get a MAXSIZE (0xff..ff).
-                string(s, strnlen(s, f.precision), &f, putc, buf);
+                string(s, strnlen(s, f.precision), &f, putn, buf);
                 break;
             }
             case 'p': {
                 void* p = va_arg(va, void*);
                 f.flags = HASH;
-                ntoa((uintptr_t)p, false, false, &BASE_x, &f, putc, buf);
+                ntoa((uintptr_t)p, false, false, &BASE_x, &f, putn, buf);
                 break;
             }
             case 'f':
@@ -639,11 +704,14 @@ void __vprintf(const char* format, va_list va, void (*putc)(char, void*), void*
             case 'G':
             case 'n':
                 // We currently don't support floating-point formatting and %n
-                __printf("Unsupported formatting option %%%c.", putc, buf, *format);
+                __printf("Unsupported formatting option %%%c.", putn, buf, *format);
                 break;
             default:
-                __printf("Unknown formatting option %%%c.", putc, buf, *format);
+                __printf("Unknown formatting option %%%c.", putn, buf, *format);
                 break;
         }
+
+        // Step past the conversion character.
+        format++;
     }
 }
\ No newline at end of file
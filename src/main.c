@@ -18,12 +18,20 @@
 
 #include <dev/uart.h>
 #include <dev/timer.h>
+#include <dev/plic.h>
+#include <dev/klog.h>
+#include <dev/virtio.h>
+#include <dev/bcache.h>
 
 #include <mm/pmm.h>
 #include <mm/vmm.h>
 #include <mm/malloc.h>
+#include <mm/slab.h>
 
 #include <trap/trap.h>
+#include <trap/interrupt.h>
+
+#include <bench.h>
 
 #include <threads/thread.h>
 
@@ -31,6 +39,14 @@
 
 uint8_t kernel_stack[NUM_HART * 4096] __attribute__((section(".stack")));
 
+// The release flag for the secondary harts. The secondary harts spin on this flag in boot.S
+// until the boot hart has finished initializing the global kernel state.
+volatile uint64_t boot_released = 0;
+
+// The user-mode init program, assembled into the kernel image (see src/user/init.S).
+extern uint8_t user_init_start[];
+extern uint8_t user_init_end[];
+
 
 /*
  * Procedure:   init
@@ -71,6 +87,10 @@ void init() {
     mie &= ~(MIE_MTIE | MIE_MSIE | MIE_MEIE);
     w_mie(mie);
 
+    // Expose the hardware performance counters (cycle, time, instret) to
+    // supervisor mode — without this, rdcycle & friends trap.
+    w_mcounteren(MCOUNTEREN_CY | MCOUNTEREN_TM | MCOUNTEREN_IR);
+
     // To access the hartid from supervisor mode, we store it in the tp register
     w_hartid(r_mhartid());
 
@@ -80,14 +100,21 @@ void init() {
     asm("mret");
 }
 
+void th_f1(void* data) {
+    info("Thread %d started...\n", thread_tid());
+    info("%d ticks\n", timer_ticks());
+}
+
 /*
  * Procedure:   main
  * -----------------
+ * The boot hart (hart 0) initializes the global kernel state and then releases the
+ * secondary harts (spinning in boot.S). The secondary harts then perform their
+ * hart-local initialization and start scheduling threads.
  *
  */
 void main() {
 
-    // For testing, this always holds true
     if (r_hartid() == 0) {
         thread_init();
         thread_hart_init();
@@ -109,6 +136,7 @@ void main() {
 
         // Initialize thread and uart virtual memory (vm) here (special since uart is used for logging)
         uart_vm_init();
+        virtio_blk_vm_init();
         thread_vm_init();
 
         vmm_hart_init();
@@ -118,20 +146,73 @@ void main() {
         malloc_init();
         info("malloc initialized.\n");
 
+        info("slab initializing...\n");
+        slab_init();
+        info("slab initialized.\n");
+
+        // With the PMM up, logging switches from the synchronous early-boot path to
+        // the in-memory log ring.
+        info("klog initializing...\n");
+        klog_init();
+        info("klog initialized.\n");
+
 
         info("Traps initializing...\n");
         trap_init();
         trap_hart_init();
+        plic_hart_init();
         info("Traps initialized.\n");
 
+        virtio_blk_init();
+        if (virtio_blk_present()) {
+            bcache_init();
+            info("Buffer cache initialized.\n");
+        }
+
         scheduler_start();
 
+        // Now that the scheduler is running, create the log flusher and page scrubber
+        // threads.
+        klog_flusher_init();
+        pmm_scrubber_init();
+
+        // The global kernel state is now initialized, so release the secondary harts.
+        __sync_synchronize();
+        boot_released = 1;
+
+#ifdef BENCH
+        // Benchmark builds skip the demo threads: the suite wants the machine to
+        // itself (see bench.c and the bench target in build/Makefile).
+        bench_run();
+#else
+        tid_t t1 = kthread_create("t1", th_f1, null);
+        info("Thread t1: %d\n", t1);
+
+        tid_t t2 = kthread_create("t2", th_f1, null);
+        info("Thread t2: %d\n", t2);
+
+        // Start the user-mode init program :)
+        tid_t u = uprocess_create("init", user_init_start, (size_t)(user_init_end - user_init_start));
+        info("User init: %d\n", u);
+#endif
 
         for (;;) {
             info("Kernel thread now sleeping...\n");
             timer_sleep(10000000);
         }
-    }
+    } else {
+        // Secondary harts perform their hart-local initialization. Note that the
+        // machine-mode initialization (init) has already executed on this hart.
+        thread_hart_init();
+        vmm_hart_init();
+        trap_hart_init();
+        plic_hart_init();
 
-    while (true);
+        scheduler_start();
+
+        // The initial kernel thread of a secondary hart has nothing left to do,
+        // so block forever and let this hart's scheduler take over.
+        intr_disable();
+        for (;;) thread_block();
+    }
 }
\ No newline at end of file
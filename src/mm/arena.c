@@ -0,0 +1,129 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/16/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        arena.c
+//      Environment: Tiny OS
+//      Description: An arena allocator for transient kernel allocations. malloc is a poor fit for
+//                   workloads that make many short-lived allocations and free them all at once
+//                   (the per-allocation lock round trips and bucket headers add up, and the frees
+//                   are pure bookkeeping); an arena turns each allocation into a pointer bump and
+//                   the whole teardown into a handful of free_pages calls.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <lib/stdint.h>
+#include <lib/stddef.h>
+#include <lib/stdbool.h>
+
+#include <debug.h>
+
+#include <mm/pmm.h>
+#include <mm/arena.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ARENAS                                                                                                              //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// An arena is a chain of chunks, each a power-of-two block from the page allocator with an
+// arena_chunk_t header at it's base. Only the newest chunk is bumped into — [pos, end) — so an
+// allocation is a round-up, a bounds check and an add. When the current chunk can't fit a request
+// we grow by a fresh chunk sized to fit (at least one page), pushed to the front of the chain.
+//
+// The arena_t itself lives inside the first chunk, right after it's header, which makes
+// arena_create a single alloc_page and means there is nothing to free separately on destroy.
+//
+// Arenas are deliberately unsynchronized: an arena has a single owner (typically a thread building
+// some transient structure), and pushing the locking into the allocator would throw away most of
+// the win. Share an arena between harts and you get to keep both pieces :)
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Function:    __arena_grow
+ * -------------------------
+ * This function extends [arena] with a fresh chunk large enough to satisfy an allocation of
+ * [size] bytes (at minimum a single page), and repoints the bump region at it.
+ *
+ * @returns:    true on success, false if the page allocator had no block large enough.
+ *
+ */
+static bool __arena_grow(arena_t* arena, size_t size) {
+    size_t order = page_order(size + sizeof(arena_chunk_t));
+
+    arena_chunk_t* chunk = alloc_pages(order);
+    if (chunk == null) return false;
+
+    chunk->order = order;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    arena->pos = (uint8_t*)ROUND_UP((uint64_t)(chunk + 1), ARENA_ALIGN);
+    arena->end = (uint8_t*)chunk + (PAGE_SIZE << order);
+
+    return true;
+}
+
+/*
+ * Function:    arena_create
+ * -------------------------
+ * This function creates an empty arena backed by a single page: the chunk header, the arena_t
+ * and the initial bump space all live in that page.
+ *
+ * @returns:    The new arena, or null if no page was available.
+ *
+ */
+arena_t* arena_create(void) {
+    arena_chunk_t* chunk = alloc_page();
+    if (chunk == null) return null;
+
+    chunk->order = 0;
+    chunk->next = null;
+
+    arena_t* arena = (arena_t*)(chunk + 1);
+    arena->chunks = chunk;
+    arena->pos = (uint8_t*)ROUND_UP((uint64_t)(arena + 1), ARENA_ALIGN);
+    arena->end = (uint8_t*)chunk + PAGE_SIZE;
+
+    return arena;
+}
+
+/*
+ * Function:    arena_alloc
+ * ------------------------
+ * This function allocates [size] bytes from [arena], aligned to ARENA_ALIGN. There is no
+ * corresponding free — the memory lives until arena_destroy.
+ *
+ * @returns:    A pointer to the allocation, or null if the arena could not grow.
+ *
+ */
+void* arena_alloc(arena_t* arena, size_t size) {
+    assert(arena != null);
+    assert(size > 0);
+
+    size = ROUND_UP(size, ARENA_ALIGN);
+
+    if (arena->pos + size > arena->end && !__arena_grow(arena, size)) {
+        return null;
+    }
+
+    void* ptr = arena->pos;
+    arena->pos += size;
+    return ptr;
+}
+
+/*
+ * Procedure:   arena_destroy
+ * --------------------------
+ * This procedure frees everything [arena] ever allocated — and the arena itself — by walking
+ * the chunk chain and returning each block to the page allocator in one motion. Note that the
+ * arena_t lives in the *last* chunk of the chain (the first one created), so by the time it's
+ * page is freed we no longer touch it.
+ *
+ */
+void arena_destroy(arena_t* arena) {
+    assert(arena != null);
+
+    arena_chunk_t* chunk = arena->chunks;
+    while (chunk != null) {
+        arena_chunk_t* next = chunk->next;
+        free_pages(chunk, chunk->order);
+        chunk = next;
+    }
+}
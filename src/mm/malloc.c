@@ -6,8 +6,12 @@
 #include <lib/stdbool.h>
 #include <lib/string.h>
 
+#include <param.h>
+#include <riscv.h>
 #include <debug.h>
 
+#include <trap/interrupt.h>
+
 #include <threads/synch.h>
 
 #include <mm/pmm.h>
@@ -151,6 +155,96 @@ static inline size_t block_size(block_t* block) {
     return sblock_to_block_size(sb);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PER-HART MAGAZINES                                                                                                 //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Taking a bucket's sleeping lock for every malloc/free makes contended buckets a wall under SMP. Each hart
+// therefore keeps a small fixed-capacity stack of blocks (a "magazine") per size class: the hot path is a few
+// hart-local pointer operations with interrupts disabled and no lock at all. An empty magazine refills with a
+// batch of blocks from the shared bucket (under it's lock); a full magazine flushes a batch back.
+//
+// Note that blocks held in a magazine count as allocated from the bucket's perspective (they are not on the
+// free list and not included in sb->free_blocks), so superblock reclamation simply waits until any magazine
+// stragglers are flushed.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define MAGAZINE_CAPACITY   (16)
+#define MAGAZINE_BATCH      (MAGAZINE_CAPACITY / 2)
+
+typedef struct {
+    size_t count;
+    block_t* blocks[MAGAZINE_CAPACITY];
+} magazine_t;
+
+static magazine_t magazines[NUM_HART][NUM_BUCKET];
+
+/*
+ * Function:    bucket_pop_block
+ * -----------------------------
+ * The bucket_pop_block function pops a block from [bucket]'s free list, carving a fresh
+ * superblock into blocks if the free list is empty. The caller must hold [bucket]'s lock.
+ *
+ * @returns:    A pointer to the block, or null if no superblock could be allocated.
+ *
+ */
+static block_t* bucket_pop_block(bucket_t* bucket) {
+    // If our bucket is empty, then it follows that we need to allocate a new superblock and split it into
+    // blocks of the bucket's size.
+    if (list_size(&bucket->free_list) == 0) {
+        sblock_t* sb = alloc_pages(0);
+        if (sb == null) return null;
+
+        // Set superblock metadata.
+        sb->magic = SBLOCK_MAGIC;
+        sb->type = SBLOCK_MULTIBLOCK;
+        sb->bucket = bucket;
+
+        // The number of free blocks of order [i] is given by size / 2^i where size is the available free space
+        // So it follows that size = PAGE_SIZE - sizeof(superblock descriptor).
+        sb->free_blocks = (PAGE_SIZE - sizeof(sblock_t)) / bucket->block_size;
+
+        for (size_t j = 0; j < sb->free_blocks; j++) {
+            block_t* block = sblock_to_block(sb, j);
+            list_push_tail(&bucket->free_list, &block->list_node);
+        }
+    }
+
+    block_t* block = LIST_VALUE(block_t, list_node, list_pop_head(&bucket->free_list));
+
+    sblock_t* sb = block_to_sblock(block);
+    assert(sb->type == SBLOCK_MULTIBLOCK);
+    sb->free_blocks--;
+
+    return block;
+}
+
+/*
+ * Procedure:   bucket_push_block
+ * ------------------------------
+ * The bucket_push_block procedure pushes [block] onto [bucket]'s free list, reclaiming
+ * the owning superblock if all of it's blocks are now free. The caller must hold
+ * [bucket]'s lock.
+ *
+ */
+static void bucket_push_block(bucket_t* bucket, block_t* block) {
+    sblock_t* sb = block_to_sblock(block);
+    assert(sb->type == SBLOCK_MULTIBLOCK);
+
+    list_push_head(&bucket->free_list, &block->list_node);
+
+    size_t bpsb = blocks_per_sblock(sb);
+    if (++sb->free_blocks >= bpsb) {
+        assert(sb->free_blocks == bpsb);
+
+        for (size_t i = 0; i < bpsb; i++) {
+            block_t* b = sblock_to_block(sb, i);
+            list_delete(&bucket->free_list, &b->list_node);
+        }
+
+        free_page(sb);
+    }
+}
+
 void* malloc(size_t size) {
     if (size == 0) return null;
 
@@ -185,42 +279,55 @@ void* malloc(size_t size) {
     }
 
     bucket_t* bucket = &buckets[i];
-    lock_acquire(&bucket->lock);
 
-    // If our bucket is empty, then it follows that we need to allocate a new superblock and split it into blocks
-    // of order [i]
-    if (list_size(&bucket->free_list) == 0) {
-        sblock_t* sb = alloc_pages(0);
-        if (sb == null) {
-            lock_release(&bucket->lock);
-            return null;
-        }
+    // Hot path: pop a block from the current hart's magazine — a few hart-local
+    // pointer operations, no lock. (Interrupts are disabled so we cannot be migrated
+    // mid-operation.)
+    intr_state_t state = intr_disable();
+    magazine_t* mag = &magazines[r_hartid()][i];
 
-        // Set superblock metadata.
-        sb->magic = SBLOCK_MAGIC;
-        sb->type = SBLOCK_MULTIBLOCK;
-        sb->bucket = bucket;
+    if (mag->count > 0) {
+        block_t* block = mag->blocks[--mag->count];
+        intr_set_state(state);
+        return block;
+    }
+    intr_set_state(state);
 
-        // The number of free blocks of order [i] is given by size / 2^i where size is the available free space
-        // So it follows that size = PAGE_SIZE - sizeof(superblock descriptor).
-        sb->free_blocks = (PAGE_SIZE - sizeof(sblock_t)) / bucket->block_size;
+    // The magazine is empty: refill a batch from the shared bucket. The bucket lock is
+    // a sleeping lock, so it must not be held with interrupts disabled; the batch is
+    // staged in a local array instead.
+    block_t* batch[MAGAZINE_BATCH];
+    size_t n = 0;
 
-        for (size_t j = 0; j < sb->free_blocks; j++) {
-            block_t* block = sblock_to_block(sb, j);
-            list_push_tail(&bucket->free_list, &block->list_node);
-        }
+    lock_acquire(&bucket->lock);
+    while (n < MAGAZINE_BATCH) {
+        block_t* block = bucket_pop_block(bucket);
+        if (block == null) break;
 
+        batch[n++] = block;
     }
+    lock_release(&bucket->lock);
 
-    block_t* block = LIST_VALUE(block_t, list_node, list_pop_head(&bucket->free_list));
+    if (n == 0) return null;
 
-    sblock_t* sb = block_to_sblock(block);
-    assert(sb->type == SBLOCK_MULTIBLOCK);
-    sb->free_blocks--;
+    // Stash all but one of the batch in the magazine. (We may have been migrated while
+    // sleeping on the lock; that's fine, any hart's magazine will do.)
+    state = intr_disable();
+    mag = &magazines[r_hartid()][i];
 
-    lock_release(&bucket->lock);
+    while (n > 1 && mag->count < MAGAZINE_CAPACITY) {
+        mag->blocks[mag->count++] = batch[--n];
+    }
+    intr_set_state(state);
 
-    return block;
+    // If the magazine had no room for the whole batch, return the surplus to the bucket.
+    if (n > 1) {
+        lock_acquire(&bucket->lock);
+        while (n > 1) bucket_push_block(bucket, batch[--n]);
+        lock_release(&bucket->lock);
+    }
+
+    return batch[0];
 }
 
 void* calloc(size_t num, size_t size) {
@@ -259,22 +366,31 @@ void free(void* ptr) {
             bucket_t* bucket = sb->bucket;
             bzero(block, bucket->block_size);
 
-            lock_acquire(&bucket->lock);
+            size_t i = bucket - buckets;
 
-            list_push_head(&bucket->free_list, &block->list_node);
+            // Hot path: drop the block into the current hart's magazine.
+            intr_state_t state = intr_disable();
+            magazine_t* mag = &magazines[r_hartid()][i];
 
-            size_t bpsb = blocks_per_sblock(sb);
-            if (++sb->free_blocks >= bpsb) {
-                assert(sb->free_blocks == bpsb);
-
-                for (size_t i = 0; i < bpsb; i++) {
-                    block_t* b = sblock_to_block(sb, i);
-                    list_delete(&bucket->free_list, &b->list_node);
-                }
+            if (mag->count < MAGAZINE_CAPACITY) {
+                mag->blocks[mag->count++] = block;
+                intr_set_state(state);
+                break;
+            }
 
-                free_page(sb);
+            // The magazine is full: extract a batch to flush to the shared bucket,
+            // making room for the freed block.
+            block_t* batch[MAGAZINE_BATCH];
+            for (size_t n = 0; n < MAGAZINE_BATCH; n++) {
+                batch[n] = mag->blocks[--mag->count];
             }
+            mag->blocks[mag->count++] = block;
+            intr_set_state(state);
 
+            lock_acquire(&bucket->lock);
+            for (size_t n = 0; n < MAGAZINE_BATCH; n++) {
+                bucket_push_block(bucket, batch[n]);
+            }
             lock_release(&bucket->lock);
             break;
         }
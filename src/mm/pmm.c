@@ -4,7 +4,9 @@
 //      File:        pmm.c
 //      Environment: Tiny OS
 //      Description: Contains alloc_pages(size_t order) and free_pages(void* ptr, size_t order) methods
-//                   using a binary buddy allocator and a bitmap.
+//                   using a binary buddy allocator and a bitmap. The managed range is partitioned into
+//                   zones (DMA-low and normal), each with it's own buckets, bitmap and lock; see the
+//                   MEMORY ZONES section below.
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #include <lib/stdint.h>
@@ -12,8 +14,19 @@
 #include <lib/string.h>
 #include <lib/list.h>
 
+#include <param.h>
+#include <perf.h>
+#include <riscv.h>
 #include <debug.h>
 
+#include <trap/interrupt.h>
+
+#include <threads/spinlock.h>
+#include <threads/thread.h>
+
+#include <dev/timer.h>
+#include <dev/fdt.h>
+
 #include <mm/symbols.h>
 #include <mm/pmm.h>
 
@@ -57,8 +70,14 @@ typedef struct {
     size_t      size;
 } bitmap_t;
 
-// mm_bitmap is the memory manager's global bitmap, since we only need a single bitmap.
-static bitmap_t mm_bitmap;
+// Per-frame reference counts, used for copy-on-write page sharing (see
+// pagetable_clone in vmm.c). A count of n means n *additional* owners beyond the
+// first: frames start at 0, so the common non-shared case never touches a count
+// on the allocation path. Allocated after the bitmaps in pmm_init, and indexed
+// from the base of the whole managed range (zones share the one array — a frame's
+// owners don't care which zone it came from).
+static uint16_t* page_refcounts;
+static uintptr_t base_ptr;
 
 /*
  * Due to our implementation of a bitmap_t using a uint64_t map array, the number of
@@ -87,38 +106,40 @@ static bitmap_t mm_bitmap;
 #define BITMAP_MASK_LT(n)       ((1 << n) - 1)
 
 /*
- * To use [map], we need a quick way to test whether a given page has been allocated.
+ * To use a bitmap, we need a quick way to test whether a given page has been allocated.
  * We can simply use the PAGE_NUM_TO_INDEX and PAGE_NUM_TO_OFFSET macros
  * we defined earlier, since a page p is allocated <=> the PAGE_NUM_TO_OFFSET(p) bit is set in
- * the PAGE_NUM_TO_INDEX(p) element of mm_bitmap.map.
+ * the PAGE_NUM_TO_INDEX(p) element of the bitmap's map.
  */
-#define ALLOCATED(p)            (mm_bitmap.map[PAGE_NUM_TO_INDEX(p)] & (1 << PAGE_NUM_TO_OFFSET(p)))
+#define ALLOCATED(bitmap, p)    ((bitmap)->map[PAGE_NUM_TO_INDEX(p)] & (1 << PAGE_NUM_TO_OFFSET(p)))
 
 /*
  * Procedure:   bitmap_alloc
  * -------------------------
- * The bitmap_alloc(p, size) procedure allocates the pages in the range [p, p + size), thus allocating
- * [size] contiguous pages in the bitmap mm_bitmap. We proceed by computing the start and end indexes and
+ * The bitmap_alloc(bitmap, p, size) procedure allocates the pages in the range [p, p + size), thus allocating
+ * [size] contiguous pages in [bitmap]. We proceed by computing the start and end indexes and
  * offsets. We then have two cases:
  *  1. start_idx = end_idx =>
- *      The page bits that need to be set are in mm_bitmap.map[start_idx].
+ *      The page bits that need to be set are in bitmap->map[start_idx].
  *      So we need to set all bits >= start_off and set all bits < end_off.
  *
  *  2. start_idx != end_idx =>
  *      The page bits to be set span across multiple bitmap words.
- *      So we need to set all bits >= start_off in mm_bitmap.map[start_idx].
+ *      So we need to set all bits >= start_off in bitmap->map[start_idx].
  *      Set all bits between start_idx and end_idx and then
- *      Set all bits < end_off in mm_bitmap.map[end_idx].
+ *      Set all bits < end_off in bitmap->map[end_idx].
  *
  * Note: We assume that the pages in the range [p, p + size) are already free.
  *
+ * @bitmap_t* bitmap:   The bitmap of the zone that owns the pages.
+ *
  * @uint64_t p:     The page frame number of the page at the start of the contiguous block of
  *                  [size] pages.
  *
  * @size_t size:    The number of pages to be allocated.
  *
  */
-void bitmap_alloc(uint64_t p, size_t size) {
+void bitmap_alloc(bitmap_t* bitmap, uint64_t p, size_t size) {
     uint64_t start_idx, start_off, end_idx, end_off;
 
     start_idx = PAGE_NUM_TO_INDEX(p);
@@ -130,35 +151,37 @@ void bitmap_alloc(uint64_t p, size_t size) {
         // Case 1. Set all bits in range [start_off, end_off). The bitstring with these bits set
         // is BITMAP_MASK_GEQ(start_off) & BITMAP_MASK_LT(end_off).
 
-        mm_bitmap.map[start_idx] |= BITMAP_MASK_GEQ(start_off) & BITMAP_MASK_LT(end_off);
+        bitmap->map[start_idx] |= BITMAP_MASK_GEQ(start_off) & BITMAP_MASK_LT(end_off);
     } else {
-        // Case 2. Set all bits >= start_off in mm_bitmap.map[start_idx].
-        mm_bitmap.map[start_idx] |= BITMAP_MASK_GEQ(start_off);
+        // Case 2. Set all bits >= start_off in bitmap->map[start_idx].
+        bitmap->map[start_idx] |= BITMAP_MASK_GEQ(start_off);
 
         // Then set all bits between start_idx and end_idx.
-        while (++start_idx < end_idx) mm_bitmap.map[start_idx] = ~0L;
+        while (++start_idx < end_idx) bitmap->map[start_idx] = ~0L;
 
-        // Finally set the bits < end_off in mm_bitmap.map[end_idx].
-        mm_bitmap.map[start_idx] |= BITMAP_MASK_LT(end_off);
+        // Finally set the bits < end_off in bitmap->map[end_idx].
+        bitmap->map[start_idx] |= BITMAP_MASK_LT(end_off);
     }
 }
 
 /*
  * Procedure:   bitmap_free
  * -------------------------
- * The bitmap_free(p, size) procedure frees the pages in the range [p, p + size), thus freeing
- * [size] contiguous pages in the bitmap mm_bitmap. We proceed by simply performing the reverse
+ * The bitmap_free(bitmap, p, size) procedure frees the pages in the range [p, p + size), thus freeing
+ * [size] contiguous pages in [bitmap]. We proceed by simply performing the reverse
  * operations to that of [bitmap_alloc].
  *
  * Note: We assume that the pages in the range [p, p + size) are already allocated.
  *
+ * @bitmap_t* bitmap:   The bitmap of the zone that owns the pages.
+ *
  * @uint64_t p:     The page frame number of the page at the start of the contiguous block of
  *                  [size] pages.
  *
  * @size_t size:    The number of pages to be freed.
  *
  */
-void bitmap_free(uint64_t p, size_t size) {
+void bitmap_free(bitmap_t* bitmap, uint64_t p, size_t size) {
     uint64_t start_idx, start_off, end_idx, end_off;
 
     start_idx = PAGE_NUM_TO_INDEX(p);
@@ -167,16 +190,31 @@ void bitmap_free(uint64_t p, size_t size) {
     end_off = PAGE_NUM_TO_OFFSET(p + size);
 
     if (start_idx == end_idx) {
-        mm_bitmap.map[start_idx] &= BITMAP_MASK_LT(start_off) | BITMAP_MASK_GEQ(end_off);
+        bitmap->map[start_idx] &= BITMAP_MASK_LT(start_off) | BITMAP_MASK_GEQ(end_off);
     } else {
-        mm_bitmap.map[start_idx] &= BITMAP_MASK_LT(start_off);
-        while (++start_idx < end_idx) mm_bitmap.map[start_idx] = 0L;
-        mm_bitmap.map[start_idx] &= BITMAP_MASK_GEQ(end_off);
+        bitmap->map[start_idx] &= BITMAP_MASK_LT(start_off);
+        while (++start_idx < end_idx) bitmap->map[start_idx] = 0L;
+        bitmap->map[start_idx] &= BITMAP_MASK_GEQ(end_off);
     }
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// BINARY BUDDY ALLOCATOR                                                                                             //
+// MEMORY ZONES                                                                                                       //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The managed range is partitioned into zones, each an independent buddy allocator: it's own buckets,
+// it's own bitmap, it's own lock and it's own [base_ptr, max_ptr) address range.
+//
+//  -   ZONE_DMA is the lowest ZONE_DMA_SIZE bytes of the managed range. Device work (e.g. virtio rings)
+//      needs physically-contiguous buffers at known-low addresses; carving them from a small dedicated
+//      zone also means general allocation churn can't fragment the contiguous runs out from under it.
+//
+//  -   ZONE_NORMAL is everything else, and is where alloc_pages and the per-hart caches draw from.
+//
+// Besides the addressing constraint, zones shrink the bitmap each operation scans and give each zone
+// it's own lock, so a DMA allocation never contends with the normal-zone churn.
+//
+// Fallback: a normal allocation may raid the DMA zone as a last resort (better than failing outright),
+// but a DMA allocation never falls "up" — it's address-constrained, that's the point.
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /*
@@ -198,31 +236,77 @@ typedef struct block {
  */
 #define BUCKET_COUNT 9
 
-// The bucket of order i is stored in the buckets list at index i, that is buckets[i].
-static list_t buckets[BUCKET_COUNT];
+/*
+ * A zone is a self-contained buddy allocator over the linear range [base_ptr, max_ptr).
+ * The buckets and the bitmap are shared by every hart, so each zone is protected by it's
+ * own ticket spinlock (queue-fair: batched refills from several harts are granted in
+ * arrival order). The internal __alloc_pages and __free_pages procedures must be called
+ * with the zone's lock held; the common order-0 path avoids the lock entirely via the
+ * per-hart caches below.
+ */
+typedef struct {
+    const char* name;
 
-// Our memory manager needs to keep track of the minimum (base) pointer of the heap
-// and the maximum pointer.
-static uintptr_t base_ptr;
-static uintptr_t max_ptr;
+    uintptr_t   base_ptr;
+    uintptr_t   max_ptr;
+
+    bitmap_t    bitmap;
+    list_t      buckets[BUCKET_COUNT];
+
+    spinlock_t  lock;
+} zone_t;
+
+static zone_t zones[NUM_ZONE];
+
+// The size of the DMA zone. 4MB is overkill for a handful of virtio rings and
+// instrumentation buffers, but it's a rounding error on even the smallest machine.
+#define ZONE_DMA_SIZE               (4 * 1024 * 1024)
+
+/*
+ * The fallback policy: row z lists the zones tried by alloc_pages_zone(z, ...), in order,
+ * terminated by NUM_ZONE.
+ */
+static const size_t zone_fallbacks[NUM_ZONE][NUM_ZONE + 1] = {
+    { ZONE_DMA, NUM_ZONE, NUM_ZONE },           // ZONE_DMA: address-constrained, never falls back.
+    { ZONE_NORMAL, ZONE_DMA, NUM_ZONE },        // ZONE_NORMAL: raids the DMA zone as a last resort.
+};
 
 /*
  * Our allocator requires us to often quickly switch between page frame numbers and page frame addresses.
- * To do so, we use some simple macros: PAGE_NUM_TO_ADDR(p) converts the page frame number p to it's
- * respective physical address.
- * Similarly, the ADDR_TO_PAGE_NUM(ptr) macro converts the page frame address (given by the ptr) to
- * it's respective page frame number p.
+ * To do so, we use some simple macros: PAGE_NUM_TO_ADDR(z, p) converts the page frame number p (relative
+ * to zone [z]) to it's respective physical address.
+ * Similarly, the ADDR_TO_PAGE_NUM(z, ptr) macro converts the page frame address (given by the ptr) to
+ * it's respective page frame number p within zone [z].
  *
- * Note: PAGE_NUM_TO_ADDR(ADDR_TO_PAGE_NUM(ptr)) = ptr (and vice versa).
+ * Note: PAGE_NUM_TO_ADDR(z, ADDR_TO_PAGE_NUM(z, ptr)) = ptr (and vice versa).
  */
-#define PAGE_NUM_TO_ADDR(p)         (base_ptr + (p << PAGE_SHIFT))
-#define ADDR_TO_PAGE_NUM(ptr)       ((ptr - base_ptr) >> PAGE_SHIFT)
+#define PAGE_NUM_TO_ADDR(z, p)      ((z)->base_ptr + (p << PAGE_SHIFT))
+#define ADDR_TO_PAGE_NUM(z, ptr)    ((ptr - (z)->base_ptr) >> PAGE_SHIFT)
 
 /*
- * Function:    alloc_pages
- * ------------------------
- * The alloc_pages function returns the pointer to a block of 2^[order] free contiguous pages.
- * The page is taken from the binary buddy allocator tree using the binary buddy allocator algorithm:
+ * Function:    zone_of
+ * --------------------
+ * This function recovers the zone that owns the block at [ptr] from it's address.
+ *
+ * @returns:    The owning zone. Panics if [ptr] is outside the managed range.
+ *
+ */
+static zone_t* zone_of(void* ptr) {
+    for (size_t z = 0; z < NUM_ZONE; z++) {
+        if ((uintptr_t)ptr >= zones[z].base_ptr && (uintptr_t)ptr < zones[z].max_ptr) {
+            return &zones[z];
+        }
+    }
+
+    panic("pmm: %p is not a managed page frame.", ptr);
+    return null;
+}
+
+/*
+ * Function:    __alloc_pages
+ * --------------------------
+ * The internal __alloc_pages function returns the pointer to a block of 2^[order] free contiguous pages
+ * from [zone]. The page is taken from the binary buddy allocator tree using the binary buddy allocator algorithm:
  *  1. Find the order i >= [order] s.t the bucket of order i isn't empty.
  *  2. Remove a block from the bucket of order i.
  *  3. Recursively (or iteratively, since it's a tail-recursive algorithm)
@@ -232,6 +316,8 @@ static uintptr_t max_ptr;
  * The algorithm has a time complexity of O(log N) where log N is the number of buckets (N is the number of page frames).
  * (Our implementation is limited to 9, however, we could have a single block representing the entire heap).
  *
+ * @zone_t* zone:   The zone to allocate from. The caller must hold the zone's lock.
+ *
  * @size_t order:   The order of the block to be allocated, that is to say it specifies the number of pages to be
  *                  allocated, specifically 2^[order] pages.
  *
@@ -240,12 +326,12 @@ static uintptr_t max_ptr;
  *                  pages.
  *
  */
-void* alloc_pages(size_t order) {
+void* __alloc_pages(zone_t* zone, size_t order) {
 
     // Increment the order [i] until we either reach the end of the bucket array,
     // or we find a bucket that isn't empty.
     size_t i;
-    for (i = order; i < BUCKET_COUNT && list_size(&buckets[i]) == 0; i++);
+    for (i = order; i < BUCKET_COUNT && list_size(&zone->buckets[i]) == 0; i++);
 
     // If [i == BUCKET_COUNT], then it follows that we didn't find a non-empty bucket.
     // Hence we have no available contiguous blocks for the request, so return null.
@@ -253,7 +339,7 @@ void* alloc_pages(size_t order) {
 
     // Since [i != BUCKET_COUNT], then it follows that we found a non-emtpy bucket :)
     // So remove a block from the bucket of order [i].
-    block_t* free_block = LIST_VALUE(block_t, list_node, list_pop_head(&buckets[i]));
+    block_t* free_block = LIST_VALUE(block_t, list_node, list_pop_head(&zone->buckets[i]));
 
     // We break the block into smaller blocks until we have a block of order [order].
     block_t* buddy_block;
@@ -266,22 +352,22 @@ void* alloc_pages(size_t order) {
         buddy_block = (block_t*)((uintptr_t)free_block + (1 << (i + PAGE_SHIFT)));
 
         // Insert the free buddy block into the bucket of order [i - 1].
-        list_push_head(&buckets[i], &buddy_block->list_node);
+        list_push_head(&zone->buckets[i], &buddy_block->list_node);
     }
 
     // Allocate the pages within the free_block of order [i = order].
-    bitmap_alloc(ADDR_TO_PAGE_NUM((uintptr_t)free_block), 1 << order);
-
-    // Zero the contents of the block.
-    bzero(free_block, 1 << (order + PAGE_SHIFT));
+    bitmap_alloc(&zone->bitmap, ADDR_TO_PAGE_NUM(zone, (uintptr_t)free_block), 1 << order);
 
+    // Note that the contents of the block is *not* zeroed; callers that require
+    // zeroed memory should use alloc_page_zeroed (or zero the block themselves).
     return free_block;
 }
 
 /*
- * Procedure:   free_pages
- * -----------------------
- * The free_pages procedure frees a block of 2^[order] allocated contiguous pages.
+ * Procedure:   __free_pages
+ * -------------------------
+ * The internal __free_pages procedure frees a block of 2^[order] allocated contiguous pages,
+ * returning it to [zone]'s buddy allocator.
  * The algorithm first frees the block from the bitmap.
  * We then recursively (or iteratively, since the algorithm is tail recursive) merge buddy blocks together until we have a
  * block of order 8 (the maximum order) or reach a buddy that is of different order => the buddy's buddy (or it's child)
@@ -290,20 +376,22 @@ void* alloc_pages(size_t order) {
  * The algorithm has a time complexity of O(log N) where log N is the number of buckets (N is the number of page frames).
  * (Our implementation is limited to 9, however, we could have a single block representing the entire heap).
  *
+ * @zone_t* zone:   The zone that owns the block. The caller must hold the zone's lock.
+ *
  * @void* ptr:      The pointer to the beginning of the allocated block that is to be freed.
  *
  * @size_t order:   The order of the block to be freed, that is to say it specifies the number of pages to be
  *                  freed, specifically 2^[order] pages.
  *
  */
-void free_pages(void* ptr, size_t order) {
+void __free_pages(zone_t* zone, void* ptr, size_t order) {
 
     block_t* freed_block = (block_t*)ptr;
     block_t* buddy_block;
 
     // Free the block from the bitmap
-    uint64_t p = ADDR_TO_PAGE_NUM((uintptr_t)freed_block);
-    bitmap_free(p, 1 << order);
+    uint64_t p = ADDR_TO_PAGE_NUM(zone, (uintptr_t)freed_block);
+    bitmap_free(&zone->bitmap, p, 1 << order);
 
     while (order < BUCKET_COUNT) {
 
@@ -315,18 +403,22 @@ void free_pages(void* ptr, size_t order) {
         uint64_t mask = 1 << order;
         buddy_block = (block_t*)((uintptr_t)freed_block + (p & mask ? -mask : mask));
 
+        // The buddy must be within the zone (the final block of a zone whose page count
+        // isn't a power of two has no buddy to merge with).
+        if ((uintptr_t)buddy_block < zone->base_ptr || (uintptr_t)buddy_block >= zone->max_ptr) break;
+
         // If the buddy is allocated, or the buddy has a different order => the buddy's buddy (or its child) is allocated.
         // Then we cannot coalesce. So break.
-        if (ALLOCATED(ADDR_TO_PAGE_NUM((uintptr_t)buddy_block)) || buddy_block->order != order) break;
+        if (ALLOCATED(&zone->bitmap, ADDR_TO_PAGE_NUM(zone, (uintptr_t)buddy_block)) || buddy_block->order != order) break;
 
         // If the buddy is free, then remove it from the bucket of order [order].
-        list_delete(&buckets[order], &buddy_block->list_node);
+        list_delete(&zone->buckets[order], &buddy_block->list_node);
 
         // If freed_block is a right child, then freed_block pointer needs to be updated to the start of the new block
         // which is the pointer to the buddy_block. We also need to update the page number of the freed_block.
         if (p & mask) {
             freed_block = buddy_block;
-            p = ADDR_TO_PAGE_NUM((uintptr_t)freed_block);
+            p = ADDR_TO_PAGE_NUM(zone, (uintptr_t)freed_block);
         }
 
         // Increment the order since freed_block is now of size 2 * 2^order = 2^{order + 1} pages.
@@ -337,58 +429,381 @@ void free_pages(void* ptr, size_t order) {
     freed_block->order = order;
 
     // Insert the free block into the bucket of order [order].
-    list_push_head(&buckets[order], &freed_block->list_node);
+    list_push_head(&zone->buckets[order], &freed_block->list_node);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// PHYSICAL MEMORY MANAGER INITIALIZATION                                                                             //
+// ZEROED PAGE POOL                                                                                                   //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Zeroing freshly allocated pages on the allocation path (as the page-table walk and calloc must) places the
+// memset cost at the worst possible moment. Instead, freed single pages feed a scrub queue (via the per-hart
+// cache drains below); the scrubber thread
+// (which runs at idle priority, i.e. only when nothing else is runnable) zeroes queued pages and stocks the
+// zero pool, from which alloc_page_zeroed allocates. If the pool and queue are both empty, alloc_page_zeroed
+// falls back to zeroing on demand.
+//
+// Pages in the scrub queue and the zero pool remain *allocated* as far as the bitmap is concerned, so the
+// buddy coalescing logic never inspects their (stale) block metadata. Once the pool is fully stocked, the
+// scrubber releases further queued pages back to the buddy allocator. Since only the per-hart caches feed
+// the scrub queue, every queued page belongs to the normal zone.
+//
+// Both lists are guarded by a test-and-set guard (held with interrupts disabled), since pages are freed and
+// allocated by every hart (and from interrupt context).
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The maximum number of pages stocked in the zero pool.
+#define ZERO_POOL_MAX       (64)
+
+// The number of timer ticks the scrubber thread sleeps between scans of the scrub queue.
+#define SCRUB_INTERVAL      (100000)
+
+static list_t scrub_queue;
+static list_t zero_pool;
+static size_t zero_pool_size;
+
+static volatile uint64_t scrub_guard;
+
+static inline void scrub_lock(void) {
+    while (__sync_lock_test_and_set(&scrub_guard, 1) != 0);
+}
+
+static inline void scrub_unlock(void) {
+    __sync_lock_release(&scrub_guard);
+}
 
 /*
- * Procedure:   pmm_init
- * ---------------------
- * Initializes the physical memory manager. Due to the use of paging in RISC-V, our
- * physical memory manager manages memory using pages, PAGE_SIZE (4096) byte blocks
- * of physical memory.
- * pmm_init first allocates the space for the bitmap [mm_bitmap].
- * The buddy block structures (and bucket lists) do not require any additional space
- * since the buckets are stored in BSS and the blocks are stored in their respective
- * free blocks. After initializing the bitmap, we initialize the buckets and fill
- * them with the available blocks.
+ * Function:    alloc_page_zeroed
+ * ------------------------------
+ * The alloc_page_zeroed function returns a pointer to a zeroed page. The page is taken
+ * from the zero pool when possible (in which case no zeroing occurs on the allocation
+ * path); otherwise we fall back to zeroing on demand.
+ *
+ * @returns:        A pointer to a zeroed page, or null if there are no available free pages.
  *
  */
-void pmm_init() {
+void* alloc_page_zeroed() {
+    intr_state_t state = intr_disable();
+    scrub_lock();
+
+    if (list_size(&zero_pool) != 0) {
+        list_node_t* node = list_pop_head(&zero_pool);
+        zero_pool_size--;
+
+        scrub_unlock();
+        intr_set_state(state);
 
-    // Determine the number of bytes required by the bitmap.
-    // We note that size = (HEAP_SIZE / PAGE_SIZE) / 8 = HEAP_SIZE >> (PAGE_SHIFT + 3).
-    mm_bitmap.size = HEAP_SIZE >> (PAGE_SHIFT + 3);
+        // The only non-zero bytes of a pooled page are it's embedded list node.
+        bzero(node, sizeof(list_node_t));
+        return node;
+    }
 
-    // The bitmap is allocated the space at the start of the heap.
-    mm_bitmap.map = (uint64_t*)(HEAP_START);
+    // The pool is empty; take an unscrubbed page from the scrub queue if there is one
+    // (saving the buddy allocator a trip) and zero it on demand.
+    if (list_size(&scrub_queue) != 0) {
+        list_node_t* node = list_pop_head(&scrub_queue);
 
-    // The base pointer of the memory manager is set after the bitmap.
-    // It must be page aligned.
-    base_ptr = PAGE_ROUND_UP(HEAP_START + mm_bitmap.size);
+        scrub_unlock();
+        intr_set_state(state);
 
-    // The max_ptr of the memory manager is MEMORY_END (which is page aligned by definition).
-    max_ptr = MEMORY_END;
+        bzero(node, PAGE_SIZE);
+        return node;
+    }
 
-    // We calculate the range for determining number of pages and
-    // initializing the bucket list.
-    uint64_t range = (max_ptr - base_ptr) >> PAGE_SHIFT;
+    scrub_unlock();
+    intr_set_state(state);
 
-    // We allocate all pages by default (avoids attempting to allocate pages that are "free" in the bitmap, but
-    // actually allocated).
-    memset(mm_bitmap.map, ~0, mm_bitmap.size);
+    void* p = alloc_page();
+    if (p != null) bzero(p, PAGE_SIZE);
+    return p;
+}
 
-    // We now free up the memory we *know* is free.
-    bitmap_free(ADDR_TO_PAGE_NUM(base_ptr), range);
+/*
+ * Procedure:   pmm_scrubber
+ * -------------------------
+ * The body of the scrubber thread: drain the scrub queue, zeroing pages into the zero
+ * pool until it is fully stocked and releasing the rest back to the buddy allocator.
+ *
+ */
+static void pmm_scrubber(UNUSED void* data) {
+    for (;;) {
+        for (;;) {
+            intr_state_t state = intr_disable();
+            scrub_lock();
+
+            if (list_size(&scrub_queue) == 0) {
+                scrub_unlock();
+                intr_set_state(state);
+                break;
+            }
+
+            list_node_t* node = list_pop_head(&scrub_queue);
+
+            scrub_unlock();
+            intr_set_state(state);
+
+            if (zero_pool_size < ZERO_POOL_MAX) {
+                bzero(node, PAGE_SIZE);
+
+                state = intr_disable();
+                scrub_lock();
+
+                list_push_tail(&zero_pool, node);
+                zero_pool_size++;
+
+                scrub_unlock();
+                intr_set_state(state);
+            } else {
+                // The pool is fully stocked; return the page to it's zone.
+                zone_t* zone = &zones[ZONE_NORMAL];
+                state = spinlock_acquire(&zone->lock);
+                __free_pages(zone, node, 0);
+                spinlock_release(&zone->lock, state);
+            }
+        }
 
-    // Initialize the buckets
-    for (int i = 0; i < BUCKET_COUNT; i++) list_init(&buckets[i]);
+        timer_sleep(SCRUB_INTERVAL);
+    }
+}
+
+/*
+ * Procedure:   pmm_scrubber_init
+ * ------------------------------
+ * This procedure creates the scrubber thread. It must be called once the scheduler has
+ * been started on the boot hart. The scrubber runs at PRI_MIN: since the per-hart idle
+ * threads live *outside* the ready queues, a PRI_MIN thread is only scheduled when
+ * nothing else is runnable.
+ *
+ */
+void pmm_scrubber_init() {
+    kthread_create_with_priority("scrub", pmm_scrubber, null, PRI_MIN);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PER-HART PAGE-FRAME CACHES                                                                                         //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Under SMP, every allocation would otherwise serialize on the global buckets and bitmap behind the zone lock.
+// Since the allocation profile is overwhelmingly order-0 (thread pages, page tables, malloc superblocks), each
+// hart keeps a private cache of order-0 frames: the common single-page alloc/free path touches only hart-local
+// state (with interrupts disabled, so no locking at all) and the zone core is consulted only for batched
+// refills and for higher-order blocks.
+//
+// The caches are stocked *exclusively* from the normal zone — a DMA frame must never launder through a cache
+// (it would later drain to the scrub queue and be freed into the wrong zone's bitmap), so DMA allocations and
+// frees always go to the zone core directly.
+//
+// On free, an overfull cache drains a batch into the scrub queue, which both bounds the cache and keeps the
+// zero pool stocked. As with the scrub queue, cached frames remain allocated in the bitmap.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The number of frames moved per batched refill; a cache is drained (by one batch)
+// when it grows beyond PCACHE_MAX frames.
+#define PCACHE_BATCH    (32)
+#define PCACHE_MAX      (2 * PCACHE_BATCH)
+
+static list_t page_caches[NUM_HART];
+static size_t page_cache_sizes[NUM_HART];
+
+/*
+ * Function:    alloc_pages_zone
+ * -----------------------------
+ * This function returns a pointer to a block of 2^[order] free contiguous pages from [zone],
+ * falling back to the other zones that [zone]'s policy permits (see zone_fallbacks) if it's
+ * exhausted. Order-0 normal allocations are served from the calling hart's page-frame cache.
+ *
+ * @size_t zone:    The preferred zone (ZONE_DMA or ZONE_NORMAL).
+ *
+ * @size_t order:   The order of the block to be allocated.
+ *
+ * @returns:        A pointer to the block, or null if every permitted zone is exhausted.
+ *
+ */
+void* alloc_pages_zone(size_t zone, size_t order) {
+    assert(zone < NUM_ZONE);
 
+    intr_state_t state = intr_disable();
+
+    perf_count(PERF_PAGE_ALLOC);
+
+    // The common case — an order-0 normal allocation — is served from the per-hart cache.
+    if (zone == ZONE_NORMAL && order == 0) {
+        uint64_t hartid = r_hartid();
+        list_t* cache = &page_caches[hartid];
+
+        // If the cache is empty, refill it with a batch of frames from the normal zone.
+        if (list_size(cache) == 0) {
+            zone_t* z = &zones[ZONE_NORMAL];
+
+            intr_state_t lock_state = spinlock_acquire(&z->lock);
+            for (size_t i = 0; i < PCACHE_BATCH; i++) {
+                void* p = __alloc_pages(z, 0);
+                if (p == null) break;
+
+                list_push_head(cache, (list_node_t*)p);
+                page_cache_sizes[hartid]++;
+            }
+            spinlock_release(&z->lock, lock_state);
+        }
+
+        if (list_size(cache) != 0) {
+            void* p = list_pop_head(cache);
+            page_cache_sizes[hartid]--;
+
+            intr_set_state(state);
+            return p;
+        }
+
+        // The normal zone is exhausted: fall through to the zone cores, which will
+        // raid the DMA zone (such a frame comes from — and is freed to — it's own
+        // zone, never the cache).
+    }
+
+    // Try each zone the policy permits, in order.
+    void* p = null;
+    for (const size_t* z = zone_fallbacks[zone]; *z != NUM_ZONE; z++) {
+        zone_t* target = &zones[*z];
+
+        intr_state_t lock_state = spinlock_acquire(&target->lock);
+        p = __alloc_pages(target, order);
+        spinlock_release(&target->lock, lock_state);
+
+        if (p != null) break;
+    }
+
+    intr_set_state(state);
+    return p;
+}
+
+void* alloc_pages(size_t order) {
+    return alloc_pages_zone(ZONE_NORMAL, order);
+}
+
+void free_pages(void* ptr, size_t order) {
+    intr_state_t state = intr_disable();
+
+    perf_count(PERF_PAGE_FREE);
+
+    // A copy-on-write shared frame is only truly freed by it's last owner; every
+    // other owner just drops it's share. (Only order-0 frames are ever shared.)
+    if (order == 0 && page_ref_dec(ptr) > 0) {
+        intr_set_state(state);
+        return;
+    }
+
+    zone_t* zone = zone_of(ptr);
+
+    // Higher-order blocks — and anything from the DMA zone — return to the zone core
+    // directly (the caches hold normal order-0 frames only).
+    if (order != 0 || zone != &zones[ZONE_NORMAL]) {
+        intr_state_t lock_state = spinlock_acquire(&zone->lock);
+        __free_pages(zone, ptr, order);
+        spinlock_release(&zone->lock, lock_state);
+
+        intr_set_state(state);
+        return;
+    }
+
+    uint64_t hartid = r_hartid();
+    list_t* cache = &page_caches[hartid];
+
+    list_push_head(cache, (list_node_t*)ptr);
+
+    // If the cache has grown beyond it's bound, drain a batch into the scrub queue
+    // (stocking the zero pool as a side effect).
+    if (++page_cache_sizes[hartid] > PCACHE_MAX) {
+        scrub_lock();
+        for (size_t i = 0; i < PCACHE_BATCH; i++) {
+            list_push_tail(&scrub_queue, list_pop_head(cache));
+            page_cache_sizes[hartid]--;
+        }
+        scrub_unlock();
+    }
+
+    intr_set_state(state);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// COW REFERENCE COUNTS                                                                                               //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// The refcount array spans the whole managed range (every zone), indexed from [base_ptr].
+#define REF_PAGE_NUM(ptr)       (((uintptr_t)(ptr) - base_ptr) >> PAGE_SHIFT)
+
+/*
+ * Procedure:   page_ref_inc
+ * -------------------------
+ * Registers an additional owner of the page frame at [ptr].
+ *
+ * @void* ptr:      The page frame.
+ *
+ */
+void page_ref_inc(void* ptr) {
+    __sync_fetch_and_add(&page_refcounts[REF_PAGE_NUM(ptr)], 1);
+}
+
+/*
+ * Function:    page_ref_dec
+ * -------------------------
+ * Drops one owner of the page frame at [ptr], returning the count *before* the
+ * decrement. A count of 0 is never decremented (it means the caller is the sole
+ * owner) — so concurrent callers racing on a shared frame are cleanly serialized:
+ * exactly one of them observes 0 and inherits the frame.
+ *
+ * @void* ptr:      The page frame.
+ *
+ * @returns:        the number of additional owners before the call.
+ *
+ */
+size_t page_ref_dec(void* ptr) {
+    uint16_t* count = &page_refcounts[REF_PAGE_NUM(ptr)];
+
+    while (true) {
+        uint16_t c = *count;
+        if (c == 0) return 0;
+        if (__sync_bool_compare_and_swap(count, c, c - 1)) return c;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// PHYSICAL MEMORY MANAGER INITIALIZATION                                                                             //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Procedure:   __zone_init
+ * ------------------------
+ * This procedure initializes [zone] as a buddy allocator over [base, max): it's lock and
+ * buckets are initialized, it's bitmap (whose storage must already be set in zone->bitmap)
+ * is initialized in a single streaming pass, and the range is carved into maximal blocks.
+ *
+ * The bitmap pass avoids marking every page allocated and then freeing the whole range bit
+ * by bit: free memory is one contiguous region, so only the word straddling it's end needs
+ * bit-level attention — everything below is wholly free, everything above (the slack at the
+ * bitmap's tail) is marked allocated so it can never be handed out.
+ *
+ */
+static void __zone_init(zone_t* zone, const char* name, uintptr_t base, uintptr_t max) {
+    zone->name = name;
+    zone->base_ptr = base;
+    zone->max_ptr = max;
+
+    spinlock_init(&zone->lock);
+    for (int i = 0; i < BUCKET_COUNT; i++) list_init(&zone->buckets[i]);
+
+    uint64_t range = (max - base) >> PAGE_SHIFT;
+
+    uint64_t full_words = range / PAGES_PER_WORD;
+    uint64_t tail = range & (PAGES_PER_WORD - 1);
+
+    memset(zone->bitmap.map, 0, full_words * sizeof(uint64_t));
+
+    size_t slack = zone->bitmap.size - full_words * sizeof(uint64_t);
+    if (slack > 0) {
+        memset(&zone->bitmap.map[full_words], ~0, slack);
+        if (tail != 0) zone->bitmap.map[full_words] = ~((1UL << tail) - 1);
+    }
+
+    // Carve the range into maximal blocks and stock the buckets.
     block_t* block;
-    uintptr_t min = base_ptr;
+    uintptr_t min = base;
     int i;
 
     while (range > 0) {
@@ -401,10 +816,80 @@ void pmm_init() {
         // Create block and insert it into the correct bucket.
         block = (block_t*)min;
         block->order = i;
-        list_push_head(&buckets[i], &block->list_node);
+        list_push_head(&zone->buckets[i], &block->list_node);
 
         // Modify min and range accordingly with the allocated block.
         min += 1 << (i + PAGE_SHIFT);
         range -= 1 << i;
     }
+
+    info("pmm: zone %s: [%p, %p)\n", name, (void*)base, (void*)max);
+}
+
+/*
+ * Procedure:   pmm_init
+ * ---------------------
+ * Initializes the physical memory manager. Due to the use of paging in RISC-V, our
+ * physical memory manager manages memory using pages, PAGE_SIZE (4096) byte blocks
+ * of physical memory.
+ * pmm_init first allocates the space for the per-zone bitmaps and the reference
+ * counts at the start of the heap. The buddy block structures (and bucket lists) do
+ * not require any additional space since the buckets are stored in BSS and the
+ * blocks are stored in their respective free blocks. The remaining (page aligned)
+ * range is then split between the zones: the lowest ZONE_DMA_SIZE bytes form
+ * ZONE_DMA and everything above is ZONE_NORMAL.
+ *
+ */
+void pmm_init() {
+
+    // Discover the actual extent of RAM from the device tree, so the same kernel
+    // image sizes itself to a 128MB, 1GB or 4GB machine without a rebuild.
+    // (fdt_memory_end falls back to the linker's MEMORY_END if no DTB was given.)
+    uint64_t memory_end = fdt_memory_end();
+    uint64_t heap_size = memory_end - HEAP_START;
+
+    // Determine the number of bytes required by the bitmaps. The DMA zone's bitmap is
+    // sized exactly for it's ZONE_DMA_SIZE range; the normal zone's is (generously)
+    // sized for the whole heap, as before. Both are rounded to whole words.
+    size_t dma_map_size = ROUND_UP(ZONE_DMA_SIZE >> (PAGE_SHIFT + 3), sizeof(uint64_t));
+    size_t normal_map_size = ROUND_UP(heap_size >> (PAGE_SHIFT + 3), sizeof(uint64_t));
+
+    // The bitmaps are allocated the space at the start of the heap: DMA's first,
+    // then the normal zone's.
+    zones[ZONE_DMA].bitmap.map = (uint64_t*)(HEAP_START);
+    zones[ZONE_DMA].bitmap.size = dma_map_size;
+
+    zones[ZONE_NORMAL].bitmap.map = (uint64_t*)(HEAP_START + dma_map_size);
+    zones[ZONE_NORMAL].bitmap.size = normal_map_size;
+
+    // The per-frame reference counts sit directly after the bitmaps, one count per
+    // heap page. (Slightly generous — the pages holding the bitmaps and the counts
+    // themselves are covered too — but that's a few KB of slack.)
+    page_refcounts = (uint16_t*)(HEAP_START + dma_map_size + normal_map_size);
+    size_t refcounts_size = (heap_size >> PAGE_SHIFT) * sizeof(uint16_t);
+    memset(page_refcounts, 0, refcounts_size);
+
+    // The base pointer of the managed range is set after the bitmaps and the
+    // reference counts. It must be page aligned.
+    base_ptr = PAGE_ROUND_UP(HEAP_START + dma_map_size + normal_map_size + refcounts_size);
+
+    // The zone boundary: the DMA zone claims the lowest ZONE_DMA_SIZE bytes of the
+    // managed range, the normal zone everything up to the discovered end of memory
+    // (which is page aligned by definition).
+    uintptr_t dma_end = base_ptr + ZONE_DMA_SIZE;
+    assert(dma_end < memory_end);
+
+    // Initialize the zeroed page pool.
+    list_init(&scrub_queue);
+    list_init(&zero_pool);
+    zero_pool_size = 0;
+
+    // Initialize the per-hart page-frame caches.
+    for (int i = 0; i < NUM_HART; i++) {
+        list_init(&page_caches[i]);
+        page_cache_sizes[i] = 0;
+    }
+
+    __zone_init(&zones[ZONE_DMA], "dma", base_ptr, dma_end);
+    __zone_init(&zones[ZONE_NORMAL], "normal", dma_end, memory_end);
 }
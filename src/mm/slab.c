@@ -0,0 +1,281 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        slab.c
+//      Environment: Tiny OS
+//      Description: A slab allocator for fixed-size kernel objects. The power-of-two malloc buckets waste up
+//                   to half of each allocation for our common 40-70 byte structures; a slab cache carves
+//                   page-sized slabs into exactly object-sized slots and preserves constructed objects across
+//                   free/alloc cycles, so hot create/destroy paths skip repeated initialization.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <lib/stdint.h>
+#include <lib/stdbool.h>
+#include <lib/string.h>
+#include <lib/list.h>
+
+#include <debug.h>
+
+#include <trap/interrupt.h>
+
+#include <mm/pmm.h>
+#include <mm/slab.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SLABS                                                                                                              //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// A slab is a single page: a header (slab_t) at the base of the page followed by an array of object slots.
+// Free slots are tracked with a small bitmap in the header rather than a free list threaded through the
+// objects themselves — this is what lets a freed object keep it's constructed contents intact until it is
+// handed out again.
+//
+// A cache keeps it's slabs on two lists: slabs with at least one free slot (partial) and exhausted slabs
+// (full). Allocation takes the head partial slab and a find-first-set over it's bitmap; a slab whose slots
+// are all free is returned to the page allocator.
+//
+// As with the rest of the MM layer, each cache is protected by a test-and-set guard held with interrupts
+// disabled, since objects are allocated and freed by every hart (and from the scheduler with interrupts off).
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define SLAB_MAGIC          (0x51ab51ab51ab51abL)
+
+// The free bitmap covers up to 256 slots; with a minimum object size of 16 bytes a
+// page can hold at most (PAGE_SIZE - sizeof(slab_t)) / 16 < 256 objects.
+#define SLAB_MAP_WORDS      (4)
+#define MIN_OBJECT_SIZE     (16)
+
+typedef struct {
+    uint64_t magic;
+
+    struct slab_cache* cache;
+
+    // The number of free slots and the free bitmap: bit i set <=> slot i is free.
+    size_t free_count;
+    uint64_t free_map[SLAB_MAP_WORDS];
+
+    // Position in the owning cache's partial or full list.
+    list_node_t list_node;
+} slab_t;
+
+typedef struct slab_cache {
+    char name[32];
+
+    size_t object_size;
+    size_t objects_per_slab;
+
+    // An optional constructor, run once per slot when a slab is carved. Since freed
+    // objects are not scribbled on, the constructed state survives free/alloc cycles.
+    void (*ctor)(void* object);
+
+    list_t partial_slabs;
+    list_t full_slabs;
+
+    volatile uint64_t guard;
+
+    bool used;
+} slab_cache_t;
+
+// Caches are drawn from a small static pool, so the slab subsystem does not depend
+// on malloc (indeed, malloc could be a client of it).
+#define NUM_SLAB_CACHE      (16)
+static slab_cache_t caches[NUM_SLAB_CACHE];
+
+// Object slots begin after the header, aligned to 16 bytes.
+#define SLAB_HEADER_SIZE    (ROUND_UP(sizeof(slab_t), 16))
+
+static inline void cache_lock(slab_cache_t* cache) {
+    while (__sync_lock_test_and_set(&cache->guard, 1) != 0);
+}
+
+static inline void cache_unlock(slab_cache_t* cache) {
+    __sync_lock_release(&cache->guard);
+}
+
+static inline void* slab_object(slab_t* slab, size_t i) {
+    return (void*)((uintptr_t)slab + SLAB_HEADER_SIZE + i * slab->cache->object_size);
+}
+
+/*
+ * Function:    slab_carve
+ * -----------------------
+ * This function allocates and carves a fresh slab for [cache]: the header is initialized,
+ * every slot is marked free and the cache's constructor (if any) is run over each slot.
+ * The caller must hold [cache]'s guard.
+ *
+ * @returns:    The new slab, or null if no page was available.
+ *
+ */
+static slab_t* slab_carve(slab_cache_t* cache) {
+    slab_t* slab = alloc_pages(0);
+    if (slab == null) return null;
+
+    slab->magic = SLAB_MAGIC;
+    slab->cache = cache;
+    slab->free_count = cache->objects_per_slab;
+
+    // Mark the first [objects_per_slab] slots free.
+    for (size_t w = 0; w < SLAB_MAP_WORDS; w++) slab->free_map[w] = 0;
+    for (size_t i = 0; i < cache->objects_per_slab; i++) {
+        slab->free_map[i / 64] |= 1L << (i & 63);
+    }
+
+    if (cache->ctor != null) {
+        for (size_t i = 0; i < cache->objects_per_slab; i++) {
+            cache->ctor(slab_object(slab, i));
+        }
+    }
+
+    return slab;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// EXTERNAL SLAB METHODS                                                                                              //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void slab_init() {
+    for (size_t i = 0; i < NUM_SLAB_CACHE; i++) caches[i].used = false;
+}
+
+/*
+ * Function:    slab_cache_create
+ * ------------------------------
+ * This function creates a typed cache of objects of size [object_size] (rounded up to
+ * 8-byte alignment, with a minimum of 16 bytes). [ctor], if non-null, is run once over
+ * each slot when a slab is carved; it's effects persist across free/alloc cycles.
+ *
+ * @returns:    The new cache. Panics if the static cache pool is exhausted.
+ *
+ */
+slab_cache_t* slab_cache_create(const char* name, size_t object_size, void (*ctor)(void* object)) {
+    assert(object_size <= PAGE_SIZE - SLAB_HEADER_SIZE);
+
+    // Round the object size up to 8-byte alignment.
+    object_size = ROUND_UP(object_size, 8);
+    if (object_size < MIN_OBJECT_SIZE) object_size = MIN_OBJECT_SIZE;
+
+    // Claim a slot in the static cache pool.
+    slab_cache_t* cache = null;
+    intr_state_t state = intr_disable();
+    for (size_t i = 0; i < NUM_SLAB_CACHE; i++) {
+        if (!caches[i].used) {
+            caches[i].used = true;
+            cache = &caches[i];
+            break;
+        }
+    }
+    intr_set_state(state);
+
+    if (cache == null) panic("slab: out of cache slots (%s).", name);
+
+    strncpy(cache->name, (char*)name, 32);
+    cache->object_size = object_size;
+    cache->objects_per_slab = (PAGE_SIZE - SLAB_HEADER_SIZE) / object_size;
+    cache->ctor = ctor;
+    cache->guard = 0;
+
+    list_init(&cache->partial_slabs);
+    list_init(&cache->full_slabs);
+
+    return cache;
+}
+
+/*
+ * Function:    slab_alloc
+ * -----------------------
+ * This function allocates an object from [cache]. If the object type has a constructor,
+ * the returned object is in it's constructed state.
+ *
+ * @returns:    A pointer to the object, or null if no memory was available.
+ *
+ */
+void* slab_alloc(slab_cache_t* cache) {
+    assert(cache != null);
+
+    intr_state_t state = intr_disable();
+    cache_lock(cache);
+
+    if (list_size(&cache->partial_slabs) == 0) {
+        slab_t* slab = slab_carve(cache);
+        if (slab == null) {
+            cache_unlock(cache);
+            intr_set_state(state);
+            return null;
+        }
+
+        list_push_head(&cache->partial_slabs, &slab->list_node);
+    }
+
+    slab_t* slab = LIST_VALUE(slab_t, list_node, list_head(&cache->partial_slabs));
+
+    // Find the first free slot in the bitmap and claim it.
+    size_t i = 0;
+    for (size_t w = 0; w < SLAB_MAP_WORDS; w++) {
+        if (slab->free_map[w] != 0) {
+            i = w * 64 + __builtin_ctzl(slab->free_map[w]);
+            break;
+        }
+    }
+    slab->free_map[i / 64] &= ~(1L << (i & 63));
+
+    // If the slab is now exhausted, move it to the full list.
+    if (--slab->free_count == 0) {
+        list_pop_head(&cache->partial_slabs);
+        list_push_head(&cache->full_slabs, &slab->list_node);
+    }
+
+    void* object = slab_object(slab, i);
+
+    cache_unlock(cache);
+    intr_set_state(state);
+
+    return object;
+}
+
+/*
+ * Procedure:   slab_free
+ * ----------------------
+ * This procedure returns [object] to it's cache (recovered from the slab header at the
+ * base of the object's page). The object's contents are left untouched, so constructed
+ * state survives until the slot is reallocated. A slab whose slots are all free is
+ * released back to the page allocator.
+ *
+ */
+void slab_free(void* object) {
+    assert(object != null);
+
+    slab_t* slab = (slab_t*)PAGE_ROUND_DOWN((uintptr_t)object);
+    assert(slab->magic == SLAB_MAGIC);
+
+    slab_cache_t* cache = slab->cache;
+
+    // Recover (and sanity check) the slot index.
+    size_t offset = (uintptr_t)object - ((uintptr_t)slab + SLAB_HEADER_SIZE);
+    assert(offset % cache->object_size == 0);
+    size_t i = offset / cache->object_size;
+
+    intr_state_t state = intr_disable();
+    cache_lock(cache);
+
+    assert((slab->free_map[i / 64] & (1L << (i & 63))) == 0);
+    slab->free_map[i / 64] |= 1L << (i & 63);
+
+    // A previously exhausted slab returns to the partial list.
+    if (slab->free_count++ == 0) {
+        list_delete(&cache->full_slabs, &slab->list_node);
+        list_push_head(&cache->partial_slabs, &slab->list_node);
+    }
+
+    // If every slot is free, release the slab back to the page allocator.
+    if (slab->free_count == cache->objects_per_slab) {
+        list_delete(&cache->partial_slabs, &slab->list_node);
+
+        cache_unlock(cache);
+        intr_set_state(state);
+
+        free_pages(slab, 0);
+        return;
+    }
+
+    cache_unlock(cache);
+    intr_set_state(state);
+}
@@ -10,14 +10,23 @@
 #include <lib/stdint.h>
 #include <lib/stddef.h>
 #include <lib/stdbool.h>
+#include <lib/string.h>
 
+#include <param.h>
+#include <perf.h>
 #include <riscv.h>
 #include <debug.h>
 
+#include <trap/interrupt.h>
+
+#include <dev/fdt.h>
+
 #include <mm/symbols.h>
 #include <mm/pmm.h>
 #include <mm/vmm.h>
 
+#include <threads/thread.h>
+
 
 static pagetable_t pagetable;
 
@@ -27,7 +36,7 @@ static pagetable_t pagetable;
  *
  */
 void vmm_init() {
-    pagetable = (pagetable_t)alloc_page();
+    pagetable = (pagetable_t)alloc_page_zeroed();
 
     // TEXT
     map(pagetable, TEXT_START, TEXT_START, TEXT_END - TEXT_START, PTE_R | PTE_X);
@@ -49,9 +58,10 @@ void vmm_init() {
     map(pagetable, STACK_START, STACK_START, STACK_END - STACK_START, PTE_R | PTE_W);
     info("stack: \t%#p -> %#p\n", STACK_START, STACK_END);
 
-    // Heap
-    map(pagetable, HEAP_START, HEAP_START, HEAP_SIZE, PTE_R | PTE_W);
-    info("heap: \t%#p -> %#p\n", HEAP_START, MEMORY_END);
+    // Heap — sized by the device tree's /memory node rather than the linker's
+    // baked-in size (see dev/fdt.c), so all of a bigger machine's RAM is mapped.
+    map(pagetable, HEAP_START, HEAP_START, fdt_memory_end() - HEAP_START, PTE_R | PTE_W);
+    info("heap: \t%#p -> %#p\n", HEAP_START, fdt_memory_end());
 
 }
 
@@ -61,6 +71,9 @@ void vmm_init() {
  */
 void vmm_hart_init() {
     w_satp(SATP(pagetable));
+
+    // Invalidate any translations cached prior to the address-space switch.
+    sfence_vma();
 }
 
 
@@ -71,14 +84,17 @@ void vmm_hart_init() {
 /*
  * Procedure:   __walk
  * -------------------
- * The internal walk procedure traverses the 3-level page table structure.
+ * The internal walk procedure traverses the 3-level page table structure, descending
+ * to [target_level] and allocating intermediate page tables along the way (if permitted).
+ * A target_level of 0 yields the pte of a 4KB page, a target_level of 1 the pte of a
+ * 2MB megapage.
  */
-pte_t* __walk(pagetable_t table, vaddr_t vaddr, bool can_alloc) {
+pte_t* __walk(pagetable_t table, vaddr_t vaddr, int target_level, bool can_alloc) {
     assert(vaddr < MAX_VADDR);
 
     // Walk the page tables.
     // We assert that a page table has 3 levels.
-    for (int level = 2; level > 0; level--) {
+    for (int level = 2; level > target_level; level--) {
         pte_t *pte = &table[VPN(vaddr, level)];
 
         // This is an invalid entry, allocate a new page or return null.
@@ -86,35 +102,155 @@ pte_t* __walk(pagetable_t table, vaddr_t vaddr, bool can_alloc) {
             // If we cannot allocate a new page, then return null.
             if (!can_alloc) return null;
 
-            void* p = alloc_page();
+            // Page tables must be zeroed (a zeroed pte is simply an invalid pte).
+            void* p = alloc_page_zeroed();
             assert(p != null);
             *pte = PADDR_TO_PTE(p) | PTE_V;
         }
 
+        // We must never descend *through* a leaf; that would amount to remapping
+        // the interior of an existing megapage.
+        assert(!PTE_IS_LEAF(*pte));
+
         table = (pagetable_t)PTE_TO_PADDR(*pte);
     }
 
-    return &table[VPN(vaddr, 0)];
+    return &table[VPN(vaddr, target_level)];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TRANSLATION CACHE                                                                                                  //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// A full lookup is three dependent (and likely cache-missing) loads, yet consumers
+// like IPC page remapping and the COW fault path call walk/__find in loops over
+// contiguous ranges — nearly every lookup lands in the same 2MB region as the
+// previous one. So each hart remembers the level-0 tables of the last few regions
+// it walked: a hit skips straight to the leaf level, one load instead of three.
+//
+// The cache is hart-local (no locking; probes and fills run with interrupts
+// disabled so a hart's entries are never mixed up by preemption) and is flushed
+// for a page table whenever [unmap] or [uvm_destroy] touches it's structure.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define WALK_CACHE_SIZE (4)
+
+typedef struct {
+    pagetable_t table;      // the root the lookup was made in (null => empty)
+    vaddr_t region;         // vaddr >> VPN_SHIFT(1), i.e. the 2MB region number
+    pagetable_t leaf;       // the region's level-0 page table
+} walk_cache_entry_t;
+
+static walk_cache_entry_t walk_caches[NUM_HART][WALK_CACHE_SIZE];
+static size_t walk_cache_victims[NUM_HART];
+
+static pagetable_t walk_cache_lookup(pagetable_t table, vaddr_t vaddr) {
+    walk_cache_entry_t* cache = walk_caches[r_hartid()];
+    vaddr_t region = vaddr >> VPN_SHIFT(1);
+
+    for (size_t i = 0; i < WALK_CACHE_SIZE; i++) {
+        if (cache[i].table == table && cache[i].region == region) return cache[i].leaf;
+    }
+    return null;
+}
+
+static void walk_cache_insert(pagetable_t table, vaddr_t vaddr, pagetable_t leaf) {
+    uint64_t hartid = r_hartid();
+    walk_cache_entry_t* e = &walk_caches[hartid][walk_cache_victims[hartid]];
+
+    walk_cache_victims[hartid] = (walk_cache_victims[hartid] + 1) % WALK_CACHE_SIZE;
+
+    e->table = table;
+    e->region = vaddr >> VPN_SHIFT(1);
+    e->leaf = leaf;
+}
+
+/*
+ * Procedure:   walk_cache_invalidate
+ * ----------------------------------
+ * Flushes every hart's cached entries for [table]. Called whenever the structure
+ * of a page table changes underneath the cache (unmap, uvm_destroy) — a cached
+ * leaf table could otherwise outlive the table it belongs to.
+ *
+ * @pagetable_t table:      The page table whose entries are to be flushed.
+ *
+ */
+static void walk_cache_invalidate(pagetable_t table) {
+    for (size_t h = 0; h < NUM_HART; h++) {
+        for (size_t i = 0; i < WALK_CACHE_SIZE; i++) {
+            if (walk_caches[h][i].table == table) walk_caches[h][i].table = null;
+        }
+    }
+}
+
+/*
+ * Function:    __find
+ * -------------------
+ * The internal find function locates the leaf pte that maps [vaddr], which may reside
+ * at any level of the walk (e.g. level 1 for a 2MB megapage). The level of the returned
+ * pte is stored in [*level]. Returns null iff [vaddr] is unmapped.
+ */
+pte_t* __find(pagetable_t table, vaddr_t vaddr, int* level_out) {
+    assert(vaddr < MAX_VADDR);
+
+    intr_state_t state = intr_disable();
+
+    // Probe the translation cache first: a hit for this 2MB region skips the
+    // two upper levels of the descent.
+    pagetable_t root = table;
+    pagetable_t leaf = walk_cache_lookup(root, vaddr);
+    if (leaf != null) {
+        intr_set_state(state);
+
+        pte_t* pte = &leaf[VPN(vaddr, 0)];
+        if ((*pte & PTE_V) == 0) return null;
+
+        *level_out = 0;
+        return pte;
+    }
+
+    for (int level = 2; level >= 0; level--) {
+        pte_t* pte = &table[VPN(vaddr, level)];
+
+        if ((*pte & PTE_V) == 0) {
+            intr_set_state(state);
+            return null;
+        }
+
+        if (level == 0 || PTE_IS_LEAF(*pte)) {
+            // A full descent to level 0 means [table] is the region's leaf
+            // table; remember it for the next lookup.
+            if (level == 0) walk_cache_insert(root, vaddr, table);
+
+            intr_set_state(state);
+            *level_out = level;
+            return pte;
+        }
+
+        table = (pagetable_t)PTE_TO_PADDR(*pte);
+    }
+
+    NOT_REACHABLE;
+    return null;
 }
 
 void map_page(pagetable_t table, vaddr_t vaddr, paddr_t paddr, uint32_t flags) {
 
-    pte_t* pte = __walk(table, vaddr, true);
+    pte_t* pte = __walk(table, vaddr, 0, true);
 
     // If the pte pointer = null, then something v wrong has occurred.
     assert(pte != null);
     *pte = PADDR_TO_PTE(paddr) | flags | PTE_V;
 }
 
-void unmap_page(pagetable_t table, vaddr_t vaddr) {
+void map_megapage(pagetable_t table, vaddr_t vaddr, paddr_t paddr, uint32_t flags) {
+    assert((vaddr & (MEGAPAGE_SIZE - 1)) == 0);
+    assert((paddr & (MEGAPAGE_SIZE - 1)) == 0);
 
-    pte_t* pte = __walk(table, vaddr, false);
+    pte_t* pte = __walk(table, vaddr, 1, true);
 
-    // If the pte pointer = null, then something v wrong has also occurred.
+    // If the pte pointer = null, then something v wrong has occurred.
     assert(pte != null);
-
-    *pte = 0;
-    free_page((void*)PTE_TO_PADDR(*pte));
+    *pte = PADDR_TO_PTE(paddr) | flags | PTE_V;
 }
 
 
@@ -123,11 +259,14 @@ void unmap_page(pagetable_t table, vaddr_t vaddr) {
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 paddr_t walk(pagetable_t table, vaddr_t vaddr) {
-
-    pte_t* pte = __walk(table, vaddr, false);
+    int level;
+    pte_t* pte = __find(table, vaddr, &level);
 
     if (pte == null) return 0;
-    return PTE_TO_PADDR(*pte) | (vaddr & OFFSET_MASK);
+
+    // For an upper-level leaf, all of the vaddr bits below the leaf's level form
+    // part of the page offset.
+    return PTE_TO_PADDR(*pte) | (vaddr & (LEVEL_SIZE(level) - 1));
 }
 
 
@@ -136,19 +275,354 @@ void map(pagetable_t table, vaddr_t vaddr, paddr_t paddr, size_t n, uint32_t per
     vaddr_t vaddr_end = PAGE_ROUND_DOWN(vaddr + n - 1); // vaddr of last page
 
     while (vaddr_start <= vaddr_end) {
-        map_page(table, vaddr_start, paddr, perm);
-        vaddr_start += PAGE_SIZE; paddr += PAGE_SIZE;
+        // Emit a 2MB megapage whenever both addresses are megapage aligned and at
+        // least a megapage of the region remains; otherwise fall back to a 4KB page.
+        if ((vaddr_start & (MEGAPAGE_SIZE - 1)) == 0 && (paddr & (MEGAPAGE_SIZE - 1)) == 0
+                && vaddr_end - vaddr_start + PAGE_SIZE >= MEGAPAGE_SIZE) {
+            map_megapage(table, vaddr_start, paddr, perm);
+            vaddr_start += MEGAPAGE_SIZE; paddr += MEGAPAGE_SIZE;
+        } else {
+            map_page(table, vaddr_start, paddr, perm);
+            vaddr_start += PAGE_SIZE; paddr += PAGE_SIZE;
+        }
     }
 }
 
+// The maximum number of pages for which unmap invalidates translations individually.
+// For ranges above this threshold, a single full TLB flush is cheaper than the
+// per-page sfence.vma instructions.
+#define TLB_FLUSH_THRESHOLD (16)
+
 void unmap(pagetable_t table, vaddr_t vaddr, size_t n) {
     vaddr_t vaddr_start = PAGE_ROUND_DOWN(vaddr);
     vaddr_t vaddr_end = PAGE_ROUND_DOWN(vaddr + n - 1); // vaddr of last page
 
+    // For small ranges, it's cheaper to invalidate the unmapped pages individually
+    // than to wipe (and then refill) the entire TLB.
+    bool flush_each = n <= TLB_FLUSH_THRESHOLD * PAGE_SIZE;
+
     while (vaddr_start <= vaddr_end) {
-        unmap_page(table, vaddr_start);
-        vaddr_start += PAGE_SIZE;
+        int level;
+        pte_t* pte = __find(table, vaddr_start, &level);
+
+        // If the pte pointer = null, then something v wrong has occurred.
+        assert(pte != null);
+
+        // Read the mapped paddr *before* clearing the pte.
+        paddr_t paddr = PTE_TO_PADDR(*pte);
+        *pte = 0;
+
+        if (flush_each) sfence_vma_addr(vaddr_start);
+
+        if (level == 1) {
+            // A megapage may only be unmapped in it's entirety.
+            assert((vaddr_start & (MEGAPAGE_SIZE - 1)) == 0);
+            assert(vaddr_end - vaddr_start + PAGE_SIZE >= MEGAPAGE_SIZE);
+
+            free_pages((void*)paddr, MEGAPAGE_ORDER);
+            vaddr_start += MEGAPAGE_SIZE;
+        } else {
+            free_page((void*)paddr);
+            vaddr_start += PAGE_SIZE;
+        }
+    }
+
+    if (!flush_each) sfence_vma();
+
+    // The unmap may have emptied leaf tables; drop any translation cache entries
+    // for this page table rather than reason about which regions were affected.
+    walk_cache_invalidate(table);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// USER ADDRESS SPACES                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Each user process gets it's own page table. Rather than maintaining separate kernel
+// mappings per process, a user page table *shares* the kernel's: the top-level entries
+// of the kernel page table are copied into the user root, so the kernel executes (trap
+// handling, syscalls) without ever switching satp. The kernel's ptes have PTE_U clear,
+// so user code still can't touch them. User mappings are then added under top-level
+// slots the kernel doesn't use (see USER_TEXT_START in vmm.h).
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Function:    uvm_create
+ * -----------------------
+ * Allocates a fresh user page table sharing the kernel's mappings.
+ *
+ * @returns:    the new page table.
+ *
+ */
+pagetable_t uvm_create(void) {
+    pagetable_t table = (pagetable_t)alloc_page();
+    memcpy(table, pagetable, PAGE_SIZE);
+    return table;
+}
+
+/*
+ * Procedure:   __uvm_free
+ * -----------------------
+ * Recursively frees a user-owned page table subtree: the intermediate tables and
+ * every mapped physical page.
+ *
+ * @pagetable_t table:      The subtree's page table.
+ * @int level:              The level of [table] (2 = root).
+ *
+ */
+static void __uvm_free(pagetable_t table, int level) {
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(pte_t); i++) {
+        pte_t pte = table[i];
+        if ((pte & PTE_V) == 0) continue;
+
+        paddr_t paddr = PTE_TO_PADDR(pte);
+        if (!PTE_IS_LEAF(pte)) {
+            __uvm_free((pagetable_t)paddr, level - 1);
+        } else if (level == 1) {
+            free_pages((void*)paddr, MEGAPAGE_ORDER);
+        } else {
+            free_page((void*)paddr);
+        }
+    }
+    free_page(table);
+}
+
+/*
+ * Procedure:   uvm_destroy
+ * ------------------------
+ * Frees a user page table and every physical page mapped by it. Top-level entries
+ * copied from the kernel page table are shared, not owned, and are left alone.
+ *
+ * @pagetable_t table:      The user page table (from uvm_create).
+ *
+ */
+void uvm_destroy(pagetable_t table) {
+    walk_cache_invalidate(table);
+
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(pte_t); i++) {
+        pte_t pte = table[i];
+        if ((pte & PTE_V) != 0 && pte != pagetable[i]) {
+            __uvm_free((pagetable_t)PTE_TO_PADDR(pte), 1);
+        }
+    }
+    free_page(table);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// COPY-ON-WRITE                                                                                                      //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Duplicating an address space eagerly would copy every page of a process at spawn
+// time; for fork-style process creation that copy dominates the entire spawn path.
+// Instead, pagetable_clone duplicates only the page *tables*: the leaf frames are
+// shared between the two address spaces, write-protected and tagged PTE_COW, with
+// their sharing tracked by the per-frame reference counts in pmm.c. The first store
+// to a shared page faults, and uvm_handle_cow_fault gives the faulting process a
+// private copy of just that page — so only the pages that are actually written are
+// ever copied.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Function:    __pagetable_clone
+ * ------------------------------
+ * Recursively clones a user-owned page table subtree. Intermediate tables are
+ * copied; leaf frames are shared — each is write-protected in *both* address
+ * spaces, tagged PTE_COW, and has it's reference count bumped.
+ *
+ * @pagetable_t table:      The subtree's page table.
+ * @int level:              The level of [table] (2 = root).
+ *
+ * @returns:                the cloned subtree.
+ *
+ */
+static pagetable_t __pagetable_clone(pagetable_t table, int level) {
+    pagetable_t copy = (pagetable_t)alloc_page_zeroed();
+    if (copy == null) panic("uvm: out of memory cloning a page table.");
+
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(pte_t); i++) {
+        pte_t pte = table[i];
+        if ((pte & PTE_V) == 0) continue;
+
+        if (!PTE_IS_LEAF(pte)) {
+            pagetable_t child = __pagetable_clone((pagetable_t)PTE_TO_PADDR(pte), level - 1);
+            copy[i] = PADDR_TO_PTE((paddr_t)child) | PTE_V;
+            continue;
+        }
+
+        // User mappings are built page-by-page (see uprocess_create), so megapage
+        // leaves never appear in a user address space.
+        assert(level == 0);
+
+        // Write-protect the original and tag it COW (a no-op if the page is
+        // already shared from an earlier clone), then share the frame.
+        if ((pte & PTE_W) != 0) {
+            pte = (pte & ~PTE_W) | PTE_COW;
+            table[i] = pte;
+        }
+        page_ref_inc((void*)PTE_TO_PADDR(pte));
+        copy[i] = pte;
     }
+
+    return copy;
+}
+
+/*
+ * Function:    pagetable_clone
+ * ----------------------------
+ * Clones a user page table: the kernel's shared top-level entries are carried
+ * over as-is, user subtrees are cloned copy-on-write (see __pagetable_clone).
+ *
+ * Note that the original's writable pages become write-protected too, so the
+ * caller must be cloning the *current* address space (or one that isn't running
+ * anywhere): the sfence below only flushes stale writable translations out of
+ * this hart's TLB.
+ *
+ * @pagetable_t src:        The user page table to clone.
+ *
+ * @returns:                the cloned page table.
+ *
+ */
+pagetable_t pagetable_clone(pagetable_t src) {
+    pagetable_t dst = (pagetable_t)alloc_page();
+    memcpy(dst, src, PAGE_SIZE);
+
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(pte_t); i++) {
+        pte_t pte = src[i];
+        if ((pte & PTE_V) != 0 && pte != pagetable[i]) {
+            pagetable_t child = __pagetable_clone((pagetable_t)PTE_TO_PADDR(pte), 1);
+            dst[i] = PADDR_TO_PTE((paddr_t)child) | PTE_V;
+        }
+    }
+
+    sfence_vma();
+    return dst;
+}
+
+/*
+ * Function:    uvm_handle_cow_fault
+ * ---------------------------------
+ * Resolves a store page fault on a copy-on-write page in the current process's
+ * address space. If the faulting process turns out to be the frame's sole
+ * remaining owner, the write bit is simply restored in place; otherwise the
+ * frame is copied and the pte rewritten to point at the private copy. The
+ * reference count arbitrates racing faulters on the same frame (see
+ * page_ref_dec in pmm.c).
+ *
+ * Called from s_exc_handler with interrupts disabled.
+ *
+ * @vaddr_t vaddr:      The faulting virtual address (stval).
+ *
+ * @returns:            true iff the fault was a COW fault (and has been resolved).
+ *
+ */
+bool uvm_handle_cow_fault(vaddr_t vaddr) {
+    pagetable_t table = proc_current()->pagetable;
+    if (table == null) return false;
+
+    int level;
+    pte_t* pte = __find(table, vaddr, &level);
+    if (pte == null || (*pte & PTE_V) == 0 || (*pte & PTE_COW) == 0) return false;
+
+    assert(level == 0);
+
+    perf_count(PERF_COW_FAULT);
+
+    paddr_t paddr = PTE_TO_PADDR(*pte);
+    uint64_t flags = (*pte & PTE_FLAGS_MASK & ~PTE_COW) | PTE_W;
+
+    if (page_ref_dec((void*)paddr) == 0) {
+        // Sole owner: every other sharer has already taken it's private copy, so
+        // this frame can simply be made writable again.
+        *pte = PADDR_TO_PTE(paddr) | flags;
+    } else {
+        void* page = alloc_page();
+
+        // Running out of memory *here* is exactly the pressure scenario COW is for,
+        // so fail loudly rather than storing through a null pointer.
+        if (page == null) panic("uvm: out of memory resolving a COW fault at %p.", (void*)vaddr);
+
+        memcpy(page, (void*)paddr, PAGE_SIZE);
+        *pte = PADDR_TO_PTE((paddr_t)page) | flags;
+    }
+
+    sfence_vma_addr(vaddr);
+    return true;
+}
+
+/*
+ * Procedure:   uvm_write_protect
+ * ------------------------------
+ * Downgrades the page at [vaddr] to read-only, tagging it PTE_COW so a later
+ * write by the owner is resolved with a private copy. Used when a page becomes
+ * shared after the fact (e.g. channel_send_shared in ipc/channel.c) — a no-op
+ * if the page is already write-protected.
+ *
+ * @pagetable_t table:      The page table.
+ * @vaddr_t vaddr:          The page's virtual address.
+ *
+ */
+void uvm_write_protect(pagetable_t table, vaddr_t vaddr) {
+    int level;
+    pte_t* pte = __find(table, vaddr, &level);
+
+    assert(pte != null && (*pte & PTE_V) != 0);
+    assert(level == 0);
+
+    if ((*pte & PTE_W) != 0) {
+        *pte = (*pte & ~PTE_W) | PTE_COW;
+        sfence_vma_addr(vaddr);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ON-DEMAND STACK GROWTH                                                                                             //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Function:    uvm_handle_stack_fault
+ * -----------------------------------
+ * Resolves a page fault inside the current process's user stack range by
+ * materializing the missing page. Only the top page of the USER_STACK_PAGES
+ * range is mapped at process creation; the rest are virtual until first touched,
+ * so a thread that uses 200 bytes of stack costs one frame while deep call
+ * chains grow transparently. The common no-fault case pays nothing: there is no
+ * bookkeeping on any hot path, just this handler on the (rare) growth fault.
+ *
+ * A fault in the guard page at the bottom of the range is a stack overflow and
+ * is *not* resolved — the caller's panic path takes over, with the overflow
+ * caught at the faulting instruction rather than after the damage is done.
+ *
+ * Called from s_exc_handler with interrupts disabled.
+ *
+ * @vaddr_t vaddr:      The faulting virtual address (stval).
+ *
+ * @returns:            true iff the fault was a stack-growth fault (and the page
+ *                      has been materialized).
+ *
+ */
+bool uvm_handle_stack_fault(vaddr_t vaddr) {
+    pagetable_t table = proc_current()->pagetable;
+    if (table == null) return false;
+
+    vaddr_t stack_base = USER_STACK_TOP - USER_STACK_PAGES * PAGE_SIZE;
+    if (vaddr < stack_base || vaddr >= USER_STACK_TOP) return false;
+
+    if (vaddr < stack_base + PAGE_SIZE) {
+        warn("User stack overflow in %s: guard page hit at %p.\n", proc_name(), vaddr);
+        return false;
+    }
+
+    // Only materialize pages that are genuinely absent; a *present* pte means the
+    // fault is something else (e.g. a COW write, handled elsewhere).
+    int level;
+    pte_t* pte = __find(table, vaddr, &level);
+    if (pte != null && (*pte & PTE_V) != 0) return false;
+
+    perf_count(PERF_STACK_FAULT);
+
+    map(table, PAGE_ROUND_DOWN(vaddr), (paddr_t)alloc_page_zeroed(), PAGE_SIZE,
+            PTE_R | PTE_W | PTE_U);
+
+    sfence_vma_addr(vaddr);
+    return true;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
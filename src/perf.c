@@ -0,0 +1,54 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        perf.c
+//      Environment: Tiny OS
+//      Description: The performance counter registry. The counters themselves are bumped inline
+//                   (see perf_count in perf.h); this file just owns the storage and the dump.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <lib/stdint.h>
+
+#include <debug.h>
+#include <param.h>
+#include <riscv.h>
+
+#include <perf.h>
+
+uint64_t perf_counters[NUM_HART][PERF_MAX];
+
+// Keep in sync with perf_event_t in perf.h.
+static const char* perf_event_names[PERF_MAX] = {
+    [PERF_CTX_SWITCH]       = "ctx-switch",
+    [PERF_TRAP_INTERRUPT]   = "trap-intr",
+    [PERF_TRAP_EXCEPTION]   = "trap-exc",
+    [PERF_SYSCALL]          = "syscall",
+    [PERF_PAGE_ALLOC]       = "page-alloc",
+    [PERF_PAGE_FREE]        = "page-free",
+    [PERF_LOCK_CONTENTION]  = "lock-contention",
+    [PERF_COW_FAULT]        = "cow-fault",
+    [PERF_STACK_FAULT]      = "stack-fault",
+};
+
+/*
+ * Procedure:   perf_dump
+ * ----------------------
+ * Dumps every hart's counters (and their fleet-wide totals), together with this
+ * hart's cycle and instret readings for scale.
+ *
+ */
+void perf_dump(void) {
+    info("perf: cycle %d, instret %d.\n", r_cycle(), r_instret());
+
+    for (int e = 0; e < PERF_MAX; e++) {
+        uint64_t total = 0;
+        for (int h = 0; h < NUM_HART; h++) total += perf_counters[h][e];
+
+        // The per-hart breakdown follows in hart order (however many harts there are).
+        info("perf: %s: total %d (", perf_event_names[e], total);
+        for (int h = 0; h < NUM_HART; h++) {
+            printf(h == 0 ? "%d" : "/%d", perf_counters[h][e]);
+        }
+        printf(").\n");
+    }
+}
@@ -0,0 +1,95 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/14/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        seqlock.c
+//      Environment: Tiny OS
+//      Description:
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <debug.h>
+
+#include <threads/spinlock.h>
+#include <threads/seqlock.h>
+
+
+void seqlock_init(seqlock_t* seqlock) {
+    assert(seqlock != null);
+
+    seqlock->sequence = 0;
+    spinlock_init(&seqlock->lock);
+}
+
+/*
+ * Function:    seqlock_read_begin
+ * -------------------------------
+ * This function opens a read-side critical section: it returns the current
+ * sequence, spinning past any in-progress write (an odd sequence) so the caller
+ * doesn't read state that is guaranteed to be discarded.
+ *
+ * @returns:    The (even) sequence to pass to seqlock_read_retry.
+ *
+ */
+uint64_t seqlock_read_begin(seqlock_t* seqlock) {
+    uint64_t sequence;
+
+    // Wait out any in-progress write.
+    while ((sequence = seqlock->sequence) & 1);
+
+    // The sequence must be read before the protected state.
+    __sync_synchronize();
+
+    return sequence;
+}
+
+/*
+ * Function:    seqlock_read_retry
+ * -------------------------------
+ * This function closes a read-side critical section: it returns whether a write
+ * raced the read (i.e. the sequence has moved on), in which case the caller must
+ * retry from seqlock_read_begin.
+ *
+ */
+bool seqlock_read_retry(seqlock_t* seqlock, uint64_t sequence) {
+    // The protected state must be read before the sequence is re-checked.
+    __sync_synchronize();
+
+    return seqlock->sequence != sequence;
+}
+
+/*
+ * Function:    seqlock_write_begin
+ * --------------------------------
+ * This function opens a write-side critical section: writers are serialized by the
+ * embedded spinlock, and the odd sequence tells racing readers to retry.
+ *
+ * @returns:    The previous interrupt state, to pass to seqlock_write_end.
+ *
+ */
+intr_state_t seqlock_write_begin(seqlock_t* seqlock) {
+    intr_state_t state = spinlock_acquire(&seqlock->lock);
+
+    seqlock->sequence++;
+
+    // The sequence must be written before the protected state.
+    __sync_synchronize();
+
+    return state;
+}
+
+/*
+ * Procedure:   seqlock_write_end
+ * ------------------------------
+ * This procedure closes a write-side critical section, making the sequence even
+ * again (one write bumps the sequence by two, so readers can't mistake state from
+ * before the write for state from after it).
+ *
+ */
+void seqlock_write_end(seqlock_t* seqlock, intr_state_t state) {
+    // The protected state must be written before the sequence.
+    __sync_synchronize();
+
+    seqlock->sequence++;
+
+    assert((seqlock->sequence & 1) == 0);
+    spinlock_release(&seqlock->lock, state);
+}
@@ -0,0 +1,94 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/7/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        spinlock.c
+//      Environment: Tiny OS
+//      Description: Implements the ticket spinlock. See spinlock.h for the design notes.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <debug.h>
+#include <perf.h>
+
+#include <trap/interrupt.h>
+
+#include <threads/spinlock.h>
+
+void spinlock_init(spinlock_t* s) {
+    assert(s != null);
+
+    s->next_ticket = 0;
+    s->now_serving = 0;
+}
+
+/*
+ * Function:    spinlock_acquire
+ * -----------------------------
+ * This function acquires the spinlock [s]: interrupts are disabled, a ticket is taken and
+ * we spin until it is served. Waiters are therefore granted the lock in arrival order.
+ *
+ * @returns:    The interrupt state prior to acquisition, to be passed to spinlock_release.
+ *
+ */
+intr_state_t spinlock_acquire(spinlock_t* s) {
+    assert(s != null);
+
+    intr_state_t state = intr_disable();
+
+    uint64_t ticket = __sync_fetch_and_add(&s->next_ticket, 1);
+
+    if (s->now_serving != ticket) {
+        perf_count(PERF_LOCK_CONTENTION);
+        while (s->now_serving != ticket);
+    }
+
+    // Ensure the critical section's accesses are not reordered before the acquisition.
+    __sync_synchronize();
+
+    return state;
+}
+
+/*
+ * Function:    spinlock_try_acquire
+ * ---------------------------------
+ * This function attempts to acquire the spinlock [s] without spinning: if the lock is
+ * uncontended, we claim the next ticket with a compare-and-swap; otherwise we fail
+ * immediately. On success, the prior interrupt state is stored in [*state].
+ *
+ * @returns:    Whether the lock was acquired.
+ *
+ */
+bool spinlock_try_acquire(spinlock_t* s, intr_state_t* state) {
+    assert(s != null && state != null);
+
+    intr_state_t st = intr_disable();
+
+    // The lock is free iff the next ticket is the one being served; claiming it with a
+    // compare-and-swap grants the lock immediately.
+    uint64_t ticket = s->now_serving;
+    if (s->next_ticket == ticket
+            && __sync_bool_compare_and_swap(&s->next_ticket, ticket, ticket + 1)) {
+        __sync_synchronize();
+        *state = st;
+        return true;
+    }
+
+    intr_set_state(st);
+    return false;
+}
+
+/*
+ * Procedure:   spinlock_release
+ * -----------------------------
+ * This procedure releases the spinlock [s], serving the next waiting ticket (if any), and
+ * restores the interrupt state returned by the matching spinlock_acquire.
+ *
+ */
+void spinlock_release(spinlock_t* s, intr_state_t state) {
+    assert(s != null);
+
+    // Ensure the critical section's accesses complete before the lock is released.
+    __sync_synchronize();
+    s->now_serving++;
+
+    intr_set_state(state);
+}
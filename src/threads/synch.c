@@ -7,17 +7,130 @@
 #include <threads/synch.h>
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// WAIT QUEUES                                                                                                          //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// A wait queue is *shared* state: it is mutated by the blocking thread, by remote wakers
+// (semaphore_up may run on any hart, including from a softirq) and by priority donors
+// (thread_update_priority -> waitq_requeue runs on the donor's hart). Disabling interrupts
+// only excludes this hart, so every operation below assumes the caller holds [q->lock].
+//
+// The lock also orders blocking against remote wakeups: a blocker parks itself and goes
+// THREAD_BLOCKED under the lock, then blocks via thread_block_release — the lock is only
+// dropped (by __schedule_tail, on the blocker's behalf) once it's context is saved. A
+// waker holding the lock therefore never sees a half-parked thread, and can never pop a
+// thread that is still running on a sibling hart.
+
+void waitq_init(waitq_t* q) {
+    assert(q != null);
+
+    spinlock_init(&q->lock);
+    q->bitmap = 0;
+    for (size_t i = 0; i < NUM_PRIORITY; i++) {
+        list_init(&q->queues[i]);
+    }
+}
+
+bool waitq_empty(waitq_t* q) {
+    assert(q != null);
+    return q->bitmap == 0;
+}
+
+/*
+ * Function:    waitq_max_priority
+ * -------------------------------
+ * Returns the highest priority amongst the threads parked on [q], computed in O(1)
+ * from the queue bitmap. Used by lock_release to recompute the effective priority
+ * of a thread dropping a donated lock.
+ *
+ * @waitq_t* q:     the wait queue.
+ *
+ * @returns:        the maximum waiter priority, or PRI_MIN if [q] is empty.
+ */
+uint8_t waitq_max_priority(waitq_t* q) {
+    assert(q != null);
+
+    if (q->bitmap == 0) return PRI_MIN;
+    return 31 - __builtin_clz(q->bitmap);
+}
+
+void waitq_push(waitq_t* q, thread_t* t) {
+    assert(q != null && t != null);
+
+    uint8_t pri = t->scheduler_info.priority;
+    list_push_tail(&q->queues[pri], &t->list_node);
+    q->bitmap |= (1u << pri);
+    t->waitq = q;
+}
+
+/*
+ * Function:    waitq_pop_highest
+ * ------------------------------
+ * Removes and returns the highest-priority thread parked on [q] — a find-first-set
+ * on the bitmap followed by a pop, so no scan is required. Waiters of equal priority
+ * are woken in fifo order.
+ *
+ * @waitq_t* q:     the wait queue.
+ *
+ * @returns:        the popped thread, or null if [q] is empty.
+ */
+thread_t* waitq_pop_highest(waitq_t* q) {
+    assert(q != null);
+
+    if (q->bitmap == 0) return null;
+
+    uint8_t pri = 31 - __builtin_clz(q->bitmap);
+    thread_t* t = LIST_VALUE(thread_t, list_node, list_pop_head(&q->queues[pri]));
+    if (list_size(&q->queues[pri]) == 0) q->bitmap &= ~(1u << pri);
+
+    t->waitq = null;
+    return t;
+}
+
+/*
+ * Procedure:   waitq_requeue
+ * --------------------------
+ * Moves [t] from the queue of it's old priority to the queue of [priority]. Called
+ * by thread_update_priority when a donation boosts a thread that is blocked on a
+ * wait queue — without this the boosted thread would still be woken as if it had
+ * it's old (lower) priority.
+ *
+ * @waitq_t* q:         the wait queue [t] is parked on.
+ * @thread_t* t:        the parked thread.
+ * @uint8_t priority:   the new effective priority.
+ *
+ */
+void waitq_requeue(waitq_t* q, thread_t* t, uint8_t priority) {
+    assert(q != null && t != null && t->waitq == q);
+
+    uint8_t old = t->scheduler_info.priority;
+    if (old == priority) return;
+
+    list_delete(&q->queues[old], &t->list_node);
+    if (list_size(&q->queues[old]) == 0) q->bitmap &= ~(1u << old);
+
+    t->scheduler_info.priority = priority;
+
+    list_push_tail(&q->queues[priority], &t->list_node);
+    q->bitmap |= (1u << priority);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SEMAPHORES                                                                                                           //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 void semaphore_init(semaphore_t* s, uint64_t value) {
     assert(s != null);
 
     s->value = value;
-    list_init(&s->waiters);
+    waitq_init(&s->waiters);
 }
 
 bool semaphore_try_down(semaphore_t* s) {
     assert(s != null);
 
-    intr_state_t old_state = intr_disable();
+    intr_state_t old_state = spinlock_acquire(&s->waiters.lock);
     bool success;
     if (s->value > 0) {
         s->value--;
@@ -25,7 +138,7 @@ bool semaphore_try_down(semaphore_t* s) {
     } else {
         success = false;
     }
-    intr_set_state(old_state);
+    spinlock_release(&s->waiters.lock, old_state);
 
     return success;
 }
@@ -46,16 +159,26 @@ bool semaphore_try_down(semaphore_t* s) {
  */ 
 void semaphore_down(semaphore_t* s) {
     assert(s != null);
-    
-    intr_state_t old_state = intr_disable();
+
+    // The value and the waiter queue are shared with sibling harts (semaphores back
+    // the malloc bucket locks, the bcache, the virtio completion handshake, ...), so
+    // interrupts-off is not a critical section — everything runs under the waitq's
+    // spinlock.
+    intr_state_t old_state = spinlock_acquire(&s->waiters.lock);
     while (s->value == 0) {
-        list_push_tail(&s->waiters, &thread_current()->list_node);
-        thread_block();
+        // Park and block as one atomic step: the lock is handed off to the
+        // scheduler and only released once our context is saved, so a remote
+        // semaphore_up can't see (or wake) us until we are safely blocked.
+        waitq_push(&s->waiters, thread_current());
+        thread_block_release(&s->waiters.lock);
+
+        // Woken (interrupts still off): retake the lock and re-check — another
+        // down may have consumed the value first.
+        spinlock_acquire(&s->waiters.lock);
     }
 
     s->value--;
-    intr_set_state(old_state);
-
+    spinlock_release(&s->waiters.lock, old_state);
 }
 
 /*
@@ -73,15 +196,23 @@ void semaphore_down(semaphore_t* s) {
 void semaphore_up(semaphore_t* s) {
     assert(s != null);
 
-    intr_state_t old_state = intr_disable();
-    if (list_size(&s->waiters) != 0) {
-        thread_unblock(LIST_VALUE(thread_t, list_node, list_pop_head(&s->waiters)));
-    }
+    intr_state_t old_state = spinlock_acquire(&s->waiters.lock);
+
+    // Wake the *highest-priority* waiter rather than the fifo head — with priority
+    // donation in play, waking in fifo order would hand the resource to a
+    // low-priority thread ahead of the donor. Any thread we pop is guaranteed to be
+    // fully blocked: the blocker holds this lock until it's context is saved.
+    thread_t* t = waitq_pop_highest(&s->waiters);
+    if (t != null) thread_unblock(t);
 
     s->value++;
-    intr_set_state(old_state);
+    spinlock_release(&s->waiters.lock, old_state);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// LOCKS                                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 static inline bool lock_held_by_current_thread(const lock_t* l) {
     assert(l != null);
 
@@ -95,18 +226,55 @@ void lock_init(lock_t* l) {
     semaphore_init(&l->semaphore, 1);
 }
 
+// The maximum length of a donation chain we're willing to walk. Chains longer than
+// this are almost certainly a lock ordering bug, so bounding the walk keeps a broken
+// caller from dragging us round a cycle forever.
+#define DONATION_DEPTH_MAX  (8)
+
 void lock_acquire(lock_t* l) {
     assert(l != null && !lock_held_by_current_thread(l));
 
+    thread_t* cur = thread_current();
+
+    intr_state_t old_state = intr_disable();
+
+    if (l->holder != null) {
+        // The lock is held, so we're about to block. Donate our effective priority
+        // down the chain: boost the holder, then (if the holder is itself blocked on
+        // some other lock) that lock's holder, and so on, up to DONATION_DEPTH_MAX.
+        cur->waiting_on = l;
+
+        uint8_t priority = cur->scheduler_info.priority;
+        thread_t* holder = l->holder;
+        for (size_t depth = 0; holder != null && depth < DONATION_DEPTH_MAX; depth++) {
+            if (holder->scheduler_info.priority >= priority) break;
+            thread_update_priority(holder, priority);
+            holder = holder->waiting_on != null ? holder->waiting_on->holder : null;
+        }
+    }
+
     semaphore_down(&l->semaphore);
-    l->holder = thread_current();
+
+    cur->waiting_on = null;
+    l->holder = cur;
+    list_push_tail(&cur->held_locks, &l->list_node);
+
+    intr_set_state(old_state);
 }
 
 bool lock_try_acquire(lock_t* l) {
     assert(l != null && !lock_held_by_current_thread(l));
 
+    intr_state_t old_state = intr_disable();
+
     bool success = semaphore_try_down(&l->semaphore);
-    if (success) l->holder = thread_current();
+    if (success) {
+        thread_t* cur = thread_current();
+        l->holder = cur;
+        list_push_tail(&cur->held_locks, &l->list_node);
+    }
+
+    intr_set_state(old_state);
 
     return success;
 }
@@ -114,8 +282,118 @@ bool lock_try_acquire(lock_t* l) {
 void lock_release(lock_t* l) {
     assert(l != null && lock_held_by_current_thread(l));
 
+    thread_t* cur = thread_current();
+
+    intr_state_t old_state = intr_disable();
+
+    list_delete(&cur->held_locks, &l->list_node);
     l->holder = null;
+
+    // Any donation we received through [l] is now void. Our effective priority
+    // becomes the maximum of our base priority and the priorities still being
+    // donated through the locks we continue to hold.
+    uint8_t priority = cur->scheduler_info.base_priority;
+    list_t* held = &cur->held_locks;
+    for (list_node_t* node = list_head(held); node != &held->nil; node = node->next) {
+        lock_t* h = LIST_VALUE(lock_t, list_node, node);
+
+        // The waiter set (and hence it's maximum) can change under us from a
+        // sibling hart, so sample it under the queue's lock.
+        waitq_t* q = &h->semaphore.waiters;
+        intr_state_t qstate = spinlock_acquire(&q->lock);
+        uint8_t p = waitq_max_priority(q);
+        spinlock_release(&q->lock, qstate);
+
+        if (p > priority) priority = p;
+    }
+    cur->scheduler_info.priority = priority;
+
     semaphore_up(&l->semaphore);
+
+    intr_set_state(old_state);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// CONDITION VARIABLES                                                                                                  //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void cond_init(cond_t* c) {
+    assert(c != null);
+
+    waitq_init(&c->waiters);
+}
+
+/*
+ * Procedure:   cond_wait
+ * ----------------------
+ * This procedure atomically releases [l] and puts the current thread to sleep until
+ * [c] is signalled, re-acquiring [l] before returning. The caller must hold [l].
+ *
+ * As with any condition variable, a wakeup says the condition *may* now hold — so
+ * callers must re-check their predicate in a loop:
+ *
+ *      while (!predicate) cond_wait(&c, &l);
+ *
+ * Note that this procedure sleeps, so must not be called within the context of an
+ * interrupt handler.
+ *
+ * @cond_t* c:      the condition variable.
+ * @lock_t* l:      the lock guarding the condition. Held by the caller.
+ *
+ */
+void cond_wait(cond_t* c, lock_t* l) {
+    assert(c != null && l != null && lock_held_by_current_thread(l));
+
+    // Park *before* releasing the lock — once [l] is dropped a signaller may run,
+    // and it must be able to see us on the wait queue. The queue's lock is held
+    // from the push until our context is saved (via the hand-off in
+    // thread_block_release), so a signaller can't pop us half-parked either.
+    intr_state_t old_state = spinlock_acquire(&c->waiters.lock);
+    waitq_push(&c->waiters, thread_current());
+    lock_release(l);
+
+    thread_block_release(&c->waiters.lock);
+
+    intr_set_state(old_state);
+
+    lock_acquire(l);
+}
+
+/*
+ * Procedure:   cond_signal
+ * ------------------------
+ * Wakes the highest-priority thread waiting on [c] (if any). The caller should hold
+ * the lock associated with [c].
+ *
+ * @cond_t* c:      the condition variable.
+ *
+ */
+void cond_signal(cond_t* c) {
+    assert(c != null);
+
+    intr_state_t old_state = spinlock_acquire(&c->waiters.lock);
+    thread_t* t = waitq_pop_highest(&c->waiters);
+    if (t != null) thread_unblock(t);
+    spinlock_release(&c->waiters.lock, old_state);
+}
+
+/*
+ * Procedure:   cond_broadcast
+ * ---------------------------
+ * Wakes *all* threads waiting on [c], in priority order.
+ *
+ * @cond_t* c:      the condition variable.
+ *
+ */
+void cond_broadcast(cond_t* c) {
+    assert(c != null);
+
+    intr_state_t old_state = spinlock_acquire(&c->waiters.lock);
+    thread_t* t;
+    while ((t = waitq_pop_highest(&c->waiters)) != null) {
+        thread_unblock(t);
+    }
+    spinlock_release(&c->waiters.lock, old_state);
 }
 
 
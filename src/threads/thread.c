@@ -3,7 +3,9 @@
 
 #include <debug.h>
 #include <param.h>
+#include <perf.h>
 #include <riscv.h>
+#include <trace.h>
 
 #include <mm/pmm.h>
 #include <mm/malloc.h>
@@ -17,24 +19,46 @@
 #include <threads/thread.h>
 
 
-// Since we're implementing a preemptive round-robin scheduling algorithm, we need to define the time slice or quantum
+// Since we're implementing a preemptive scheduling algorithm, we need to define the time slice or quantum
 // for each thread. This is the number of timer ticks that the thread is allocated before being preempted.
 #define TIME_SLICE  (10000)
 
-// A list of threads with the thread->status == THREAD_READY. This list acts as a fifo queue which
-// we push and pop threads from.
-static list_t ready_threads;
-
 static proc_t kernel_proc;
 
 
 #define THREAD_MAGIC (0xe87ab59efc899600)
 
-static lock_t tid_lock;
 static tid_t next_tid = 1;
 
-static thread_t* idle_thread;
-static thread_t kernel_threads[NUM_HART];
+// The global thread registry: every live thread, linked via thread->all_node, for
+// the stats walk (see thread_stats_foreach). Threads are created and reaped on all
+// harts, so the registry is guarded by a spinlock.
+static spinlock_t all_threads_lock;
+static list_t all_threads;
+
+// The global tid index: tid -> thread_t*, so lookups by tid (monitoring, IPC) are
+// O(1) rather than a registry walk. Entries are added when a tid is assigned and
+// removed when the thread is reaped. The index starts on htable's embedded bucket
+// array, so indexing the boot hart's initial thread (which happens before the PMM
+// is up) allocates nothing.
+static spinlock_t tid_index_lock;
+static htable_t tid_index;
+
+static uint64_t tid_index_key(htable_node_t* x) {
+    return HTABLE_VALUE(thread_t, tid_node, x)->tid;
+}
+
+// tids are sequential, so spread them across the buckets with a large odd
+// multiplier (Fibonacci hashing).
+static uint64_t tid_index_hash(uint64_t key) {
+    return key * 0x9e3779b97f4a7c15ul;
+}
+
+static void tid_index_insert(thread_t* t) {
+    intr_state_t state = spinlock_acquire(&tid_index_lock);
+    htable_insert(&tid_index, &t->tid_node);
+    spinlock_release(&tid_index_lock, state);
+}
 
 static void scheduler_push(thread_t* t);
 static void schedule(void);
@@ -46,10 +70,13 @@ static void proc_deregister_thread(thread_t* t);
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // HART                                                                                                          //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//
-//
+// Each hart (hardware thread) has it's own scheduler state, namely a ready queue and an idle thread.
+// A per-hart ready queue means the common scheduling path (scheduler_push / scheduler_pop) only ever touches
+// hart-local state, so harts don't serialize on a single global queue.
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+static hart_t harts[NUM_HART];
+
 /*
  * Function:    hart_current
  * -------------------------
@@ -63,12 +90,12 @@ static void proc_deregister_thread(thread_t* t);
  * @returns:    the current hart.
  *
  */
-//hart_t* hart_current(void) {
-//    assert(intr_get_state() == INTR_OFF);
-//
-//    uint64_t hartid = r_hartid();
-//    return &harts[hartid];
-//}
+hart_t* hart_current(void) {
+    assert(intr_get_state() == INTR_OFF);
+
+    uint64_t hartid = r_hartid();
+    return &harts[hartid];
+}
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -85,19 +112,14 @@ static void proc_deregister_thread(thread_t* t);
  * -------------------------
  * This function returns a new tid, a thread identifier, to use for a new thread.
  *
- * Note that due to concurrency, we use a lock to increment the next_tid value. (When we have multi-harts)
+ * Note that due to concurrency (multiple harts may create threads simultaneously),
+ * we use an atomic fetch-and-add to increment the next_tid value.
  *
  * @returns:    The new tid that is to be used for a new thread.
  *
  */
 static tid_t allocate_tid(void) {
-    tid_t tid;
-
-    lock_acquire(&tid_lock);
-    tid = next_tid++;
-    lock_release(&tid_lock);
-
-    return tid;
+    return __sync_fetch_and_add(&next_tid, 1);
 }
 
 /*
@@ -165,6 +187,131 @@ inline tid_t thread_tid(void) {
     return thread_current()->tid;
 }
 
+/*
+ * Function:    thread_by_tid
+ * --------------------------
+ * This function looks up a thread by it's tid in the global tid index — O(1), no
+ * registry walk.
+ *
+ * Note that the returned pointer is only as stable as the thread itself: once the
+ * thread exits it may be reaped (and it's page recycled) at any point, so callers
+ * must not hold onto the pointer across anything that could let that happen.
+ *
+ * @tid_t tid:  The tid to look up.
+ *
+ * @returns:    The thread with tid [tid], or null if no such thread is live.
+ *
+ */
+thread_t* thread_by_tid(tid_t tid) {
+    intr_state_t state = spinlock_acquire(&tid_index_lock);
+    htable_node_t* n = htable_find(&tid_index, tid);
+    spinlock_release(&tid_index_lock, state);
+
+    return n == null ? null : HTABLE_VALUE(thread_t, tid_node, n);
+}
+
+/*
+ * Function:    thread_get_priority
+ * --------------------------------
+ * This function returns the base priority of the currently executing thread.
+ *
+ * @returns:    The base priority of the currently running thread.
+ *
+ */
+uint8_t thread_get_priority(void) {
+    return thread_current()->scheduler_info.base_priority;
+}
+
+/*
+ * Procedure:   thread_set_priority
+ * --------------------------------
+ * This procedure sets the base (and effective) priority of the currently executing thread
+ * to [priority]. If the thread has lowered it's priority, then we yield so that any
+ * higher-priority ready thread may run immediately.
+ *
+ * @uint8_t priority:   The new priority. Must satisfy [priority <= PRI_MAX].
+ *
+ */
+void thread_set_priority(uint8_t priority) {
+    assert(priority <= PRI_MAX);
+
+    thread_t* t = thread_current();
+
+    intr_state_t state = intr_disable();
+    t->scheduler_info.base_priority = priority;
+    t->scheduler_info.priority = priority;
+    intr_set_state(state);
+
+    thread_yield();
+}
+
+/*
+ * Procedure:   thread_update_priority
+ * -----------------------------------
+ * This procedure sets the *effective* priority of [t] to [priority] (leaving it's base
+ * priority untouched); it is the mechanism behind priority donation (see synch.c).
+ *
+ * If [t] is sitting on a ready queue, it must also be moved to the queue of it's new
+ * priority level — otherwise the boost would only take effect after the scheduler
+ * reached the old (lower) queue, defeating the donation.
+ *
+ * Note that this procedure must be called with interrupts disabled.
+ *
+ * @thread_t* t:        The thread whose effective priority is updated.
+ * @uint8_t priority:   The new effective priority. Must satisfy [priority <= PRI_MAX].
+ *
+ */
+void thread_update_priority(thread_t* t, uint8_t priority) {
+    assert(intr_get_state() == INTR_OFF);
+    assert(is_thread(t));
+    assert(priority <= PRI_MAX);
+
+    if (t->scheduler_info.priority == priority) return;
+
+    if (t->status != THREAD_READY) {
+        waitq_t* q = t->waitq;
+        if (t->status == THREAD_BLOCKED && q != null) {
+            // The thread is parked on a wait queue indexed by it's old priority —
+            // move it so the boost is visible to the next waitq_pop_highest. The
+            // requeue races with a remote waker popping [t] (and with the waker's
+            // own requeues), so it runs under the queue's lock, with the usual
+            // re-check once we hold it.
+            intr_state_t state = spinlock_acquire(&q->lock);
+            if (t->status == THREAD_BLOCKED && t->waitq == q) {
+                waitq_requeue(q, t, priority);
+            } else {
+                t->scheduler_info.priority = priority;
+            }
+            spinlock_release(&q->lock, state);
+        } else {
+            // Running threads aren't on any queue; the new priority takes effect
+            // when they are next pushed.
+            t->scheduler_info.priority = priority;
+        }
+        return;
+    }
+
+    hart_t* h = t->ready_hart;
+    intr_state_t state = spinlock_acquire(&h->ready_lock);
+
+    // Re-check under the lock: [t] may have been popped (or stolen) in the meantime.
+    if (t->status == THREAD_READY && t->ready_hart == h) {
+        uint8_t old = t->scheduler_info.priority;
+
+        list_delete(&h->ready_queues[old], &t->list_node);
+        if (list_size(&h->ready_queues[old]) == 0) h->ready_bitmap &= ~(1u << old);
+
+        t->scheduler_info.priority = priority;
+
+        list_push_tail(&h->ready_queues[priority], &t->list_node);
+        h->ready_bitmap |= (1u << priority);
+    } else {
+        t->scheduler_info.priority = priority;
+    }
+
+    spinlock_release(&h->ready_lock, state);
+}
+
 /*
  * Procedure:   thread_block
  * -------------------------
@@ -183,6 +330,32 @@ void thread_block(void) {
     intr_set_state(state);
 }
 
+/*
+ * Procedure:   thread_block_release
+ * ---------------------------------
+ * This procedure puts the current thread to sleep, handing [lock] off to the
+ * scheduler: __schedule_tail releases it on the thread's behalf once it's context
+ * has been saved. This is the blocking primitive behind the sleeping synchronization
+ * objects (see synch.c) — the caller parks itself on a wait queue under [lock], so
+ * a remote waker can neither observe a half-parked thread nor pop (and run!) it on
+ * a sibling hart before it's context is safely in memory, since the pop itself
+ * needs [lock].
+ *
+ * The caller must hold [lock] (and hence have interrupts disabled); on return the
+ * lock is no longer held and interrupts are still disabled.
+ *
+ * @spinlock_t* lock:   The spinlock to hand off to the scheduler.
+ *
+ */
+void thread_block_release(spinlock_t* lock) {
+    assert(intr_get_state() == INTR_OFF);
+    assert(lock != null);
+
+    thread_current()->status = THREAD_BLOCKED;
+    hart_current()->block_release = lock;
+    schedule();
+}
+
 /*
  * Procedure:   thread_unblock
  * ---------------------------
@@ -200,6 +373,13 @@ void thread_unblock(thread_t* t) {
     intr_state_t state = intr_disable();
 
     assert(t->status == THREAD_BLOCKED);
+
+    // A thread that blocked behaved interactively, so restore it's base priority (see
+    // the MLFQ description in the scheduler section). We only ever *raise* the priority
+    // here — lowering it could squash an active priority donation (see synch.c).
+    if (t->scheduler_info.priority < t->scheduler_info.base_priority) {
+        t->scheduler_info.priority = t->scheduler_info.base_priority;
+    }
     scheduler_push(t);
 
     intr_set_state(state);
@@ -243,7 +423,7 @@ void thread_yield(void) {
 
     intr_state_t state = intr_disable();
 
-    if (t != idle_thread) scheduler_push(t);
+    if (t != hart_current()->idle_thread) scheduler_push(t);
     schedule();
 
     intr_set_state(state);
@@ -256,8 +436,9 @@ void thread_yield(void) {
  * --------------------------
  *
  */
-static void __thread_init(thread_t* t, char* name, proc_t* p) {
+static void __thread_init(thread_t* t, char* name, proc_t* p, uint8_t priority) {
     assert(t != null && p != null);
+    assert(priority <= PRI_MAX);
 
     t->magic = THREAD_MAGIC;
     t->status = THREAD_NEW;
@@ -267,43 +448,167 @@ static void __thread_init(thread_t* t, char* name, proc_t* p) {
     t->proc = p;
     proc_register_thread(t);
 
+    t->scheduler_info.priority = priority;
+    t->scheduler_info.base_priority = priority;
+
+    // Priority donation bookkeeping.
+    t->waiting_on = null;
+    t->waitq = null;
+    list_init(&t->held_locks);
+
     t->exit_code = -1;
+
+    // Runtime accounting starts from scratch (recycled thread pages carry the
+    // previous occupant's figures).
+    t->scheduler_info.runtime = 0;
+    t->scheduler_info.last_dispatched = 0;
+    t->scheduler_info.ready_since = 0;
+    t->scheduler_info.wait_total = 0;
+    t->scheduler_info.wait_worst = 0;
+    t->scheduler_info.dispatches = 0;
+
+    intr_state_t state = spinlock_acquire(&all_threads_lock);
+    list_push_tail(&all_threads, &t->all_node);
+    spinlock_release(&all_threads_lock, state);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Short-lived worker threads are created and destroyed at a high rate, so reaped thread pages (thread_t plus
+// stack) park on a recycling pool rather than returning to the PMM. Creation takes from the pool first,
+// skipping the trip to alloc_page and re-zeroing only the thread_t header (the trap frame and context are
+// rebuilt by __kthread_create in either case). The pool is shared by all harts, so it's guarded by a
+// test-and-set guard (held with interrupts disabled; threads are reaped from the scheduler).
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define THREAD_POOL_MAX     (16)
+
+static list_t thread_pool;
+static size_t thread_pool_size;
+
+static volatile uint64_t thread_pool_guard;
+
+static inline void thread_pool_lock(void) {
+    while (__sync_lock_test_and_set(&thread_pool_guard, 1) != 0);
+}
+
+static inline void thread_pool_unlock(void) {
+    __sync_lock_release(&thread_pool_guard);
 }
 
-static thread_t* alloc_thread(char* name, proc_t* p) {
+static thread_t* alloc_thread(char* name, proc_t* p, uint8_t priority) {
     assert(p != null);
 
-    thread_t* t = alloc_page();
-    if (t == null) return null;
+    thread_t* t = null;
+
+    // Reuse a parked thread page if one is available.
+    intr_state_t state = intr_disable();
+    thread_pool_lock();
+
+    if (list_size(&thread_pool) != 0) {
+        t = LIST_VALUE(thread_t, list_node, list_pop_head(&thread_pool));
+        thread_pool_size--;
+    }
+
+    thread_pool_unlock();
+    intr_set_state(state);
+
+    if (t == null) {
+        t = alloc_page();
+        if (t == null) return null;
+    }
 
-    __thread_init(t, name, p);
+    // Only the header needs zeroing; the stack contents don't matter.
+    bzero(t, sizeof(thread_t));
+    __thread_init(t, name, p, priority);
 
     return t;
 }
 
 static inline void thread_run(thread_t* t) {
+    scheduler_info_t* si = &t->scheduler_info;
+    uint64_t now = r_time();
+
+    // Wakeup-to-dispatch latency: how long the thread sat on a ready queue since
+    // scheduler_push stamped it. The idle threads are never pushed, so their
+    // ready_since stays zero — skip them.
+    if (si->ready_since != 0) {
+        uint64_t wait = now - si->ready_since;
+        si->wait_total += wait;
+        if (wait > si->wait_worst) si->wait_worst = wait;
+        si->ready_since = 0;
+    }
+
+    si->dispatches++;
+    si->last_dispatched = now;
+
     t->status = THREAD_RUNNING;
-    t->scheduler_info.time = TIME_SLICE;
+    si->time = TIME_SLICE;
 }
 
 static void free_thread(thread_t* t) {
     assert(is_thread(t));
     assert(t->status == THREAD_DEAD);
 
-    free_page(t);
+    // Remove the thread from the global registry and the tid index.
+    intr_state_t rstate = spinlock_acquire(&all_threads_lock);
+    list_delete(&all_threads, &t->all_node);
+    spinlock_release(&all_threads_lock, rstate);
+
+    rstate = spinlock_acquire(&tid_index_lock);
+    htable_delete(&tid_index, &t->tid_node);
+    spinlock_release(&tid_index_lock, rstate);
+
     proc_deregister_thread(t);
+
+    // Park the page on the recycling pool (if there's room) rather than freeing it.
+    intr_state_t state = intr_disable();
+
+    // The dead thread no longer owns any hart's FP register file. A stale fpu_owner
+    // on a *sibling* hart is not harmless even though it's never dereferenced: the
+    // page is about to be recycled, and a new thread_t at the same address would
+    // compare pointer-equal to the stale owner — __schedule_tail would then dispatch
+    // it with FS enabled and it would silently inherit the dead thread's FP
+    // registers. The CAS only clears an owner that is still [t], so we never stomp a
+    // sibling installing it's own current thread.
+    for (int i = 0; i < NUM_HART; i++) {
+        __sync_bool_compare_and_swap(&harts[i].fpu_owner, t, null);
+    }
+
+    thread_pool_lock();
+
+    if (thread_pool_size < THREAD_POOL_MAX) {
+        // Clear the magic so a stale pointer to this thread fails is_thread.
+        t->magic = 0;
+
+        list_push_head(&thread_pool, &t->list_node);
+        thread_pool_size++;
+
+        thread_pool_unlock();
+        intr_set_state(state);
+        return;
+    }
+
+    thread_pool_unlock();
+    intr_set_state(state);
+
+    free_page(t);
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // SCHEDULER                                                                                                          //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Tiny OS uses a preemptive round-robin scheduling algorithm. We have two fifo queues, a ready threads queue,
-// designed to store threads whose status is THREAD_READY and an exited threads queue, which stores threads whose
-// status is THREAD_DEAD.
+// Tiny OS uses a preemptive multi-level feedback queue (MLFQ) scheduler. Each hart has a fifo ready queue per
+// priority level plus a bitmap with bit i set iff the queue of priority i is non-empty, so selecting the next
+// thread is an O(1) find-first-set followed by a pop (round-robin *within* a priority level).
+//
+// The feedback rules are simple: a thread that burns it's entire time slice is demoted one priority level
+// (it's behaving like a batch worker), while a thread that blocks is restored to it's base priority when it is
+// unblocked (it's behaving interactively). This keeps wakeup-to-run latency low for interactive threads without
+// starving the batch ones.
 //
 // As noted below, Tiny OS's threads and process structures are allocated on the heap, so when a thread dies we need
-// to free it's resources and potentially free the process. We do so via the exited threads queue. Prior to scheduling
+// to free it's resources and potentially free the process. Prior to scheduling
 // a new thread, the scheduler frees all resources related to dead threads. If a process has no threads, then it
 // is also freed.
 //
@@ -311,14 +616,63 @@ static void free_thread(thread_t* t) {
 
 
 static void scheduler_init(void) {
-    list_init(&ready_threads);
+    for (uint64_t i = 0; i < NUM_HART; i++) {
+        hart_t* h = &harts[i];
+
+        h->hartid = i;
+        spinlock_init(&h->ready_lock);
+        h->ready_bitmap = 0;
+        h->idle_thread = null;
+        h->fpu_owner = null;
+        h->block_release = null;
+        h->ready_count = 0;
+        h->loadavg = 0;
+
+        for (size_t pri = 0; pri < NUM_PRIORITY; pri++) list_init(&h->ready_queues[pri]);
+    }
+}
+
+/*
+ * Function:    highest_ready_priority
+ * -----------------------------------
+ * Returns the highest priority level with a non-empty ready queue on hart [h], that is
+ * the index of the highest set bit in the hart's ready bitmap.
+ *
+ * Note that the hart's ready bitmap must be non-zero.
+ *
+ */
+static inline uint8_t highest_ready_priority(hart_t* h) {
+    assert(h->ready_bitmap != 0);
+    return 31 - __builtin_clz(h->ready_bitmap);
+}
+
+/*
+ * Function:    ready_queue_remove
+ * -------------------------------
+ * Pops a thread from the ready queue of priority [pri] on hart [h], clearing the
+ * hart's bitmap bit if the queue drains. If [from_tail], the tail is popped
+ * (used by the work-stealing path), otherwise the head is popped.
+ *
+ * Note that the hart's ready_lock must be held.
+ *
+ */
+static thread_t* ready_queue_remove(hart_t* h, uint8_t pri, bool from_tail) {
+    list_t* queue = &h->ready_queues[pri];
+
+    list_node_t* node = from_tail ? list_pop_tail(queue) : list_pop_head(queue);
+    if (list_size(queue) == 0) h->ready_bitmap &= ~(1u << pri);
+    h->ready_count--;
+
+    return LIST_VALUE(thread_t, list_node, node);
 }
 
 /**
  * Procedure:   scheduler_push
  * ---------------------------
- * This procedure schedules a new thread. We maintain the assertion that
- * all threads in the ready_threads have the status THREAD_READY.
+ * This procedure schedules a new thread onto the current hart's ready queue. We maintain the
+ * assertion that all threads in the ready queue have the status THREAD_READY.
+ *
+ * Note that this procedure must be called with interrupts disabled (see hart_current).
  *
  * @thread_t* t:
  *
@@ -326,28 +680,88 @@ static void scheduler_init(void) {
 static void scheduler_push(thread_t* t) {
     assert(t != null);
 
+    hart_t* h = hart_current();
+    uint8_t pri = t->scheduler_info.priority;
+
+    assert(pri < NUM_PRIORITY);
+
     // Set the status of the thread
     t->status = THREAD_READY;
 
-    // Add the thread to the ready queue.
-    list_push_tail(&ready_threads, &t->list_node);
+    // Add the thread to the current hart's ready queue for it's priority level.
+    // Since sibling harts may steal from this queue, the hart's ready_lock (a ticket
+    // spinlock — queue-fair under contention) guards every ready queue operation.
+    intr_state_t state = spinlock_acquire(&h->ready_lock);
+    t->ready_hart = h;
+    t->scheduler_info.ready_since = r_time();
+    list_push_tail(&h->ready_queues[pri], &t->list_node);
+    h->ready_bitmap |= (1u << pri);
+    h->ready_count++;
+    spinlock_release(&h->ready_lock, state);
 }
 
+/**
+ * Function:    scheduler_steal
+ * ----------------------------
+ * Attempts to steal a thread from a sibling hart's ready queue. We steal from the *tail* of the
+ * victim's queue, since the head is the thread the victim is about to run (stealing the tail
+ * preserves the victim's fifo behavior for it's oldest threads).
+ *
+ * We deliberately use try-lock semantics on the victim's guard: a cheap steal path matters more
+ * than perfect fairness, so if a victim's queue is busy we simply move on to the next sibling.
+ *
+ * @hart_t* self:   The stealing (current) hart.
+ *
+ * @returns:        A stolen thread, or null if every sibling's queue is empty (or busy).
+ *
+ */
+static thread_t* scheduler_steal(hart_t* self) {
+    for (uint64_t i = 1; i < NUM_HART; i++) {
+        hart_t* victim = &harts[(self->hartid + i) % NUM_HART];
+
+        // Try-lock: skip victims whose queues are currently being operated on.
+        intr_state_t state;
+        if (!spinlock_try_acquire(&victim->ready_lock, &state)) continue;
+
+        thread_t* t = null;
+        if (victim->ready_bitmap != 0) {
+            t = ready_queue_remove(victim, highest_ready_priority(victim), true);
+        }
+        spinlock_release(&victim->ready_lock, state);
+
+        if (t != null) return t;
+    }
+
+    return null;
+}
 
 /**
  * Function:    scheduler_pop
  * --------------------------
- * Determines the next thread to be scheduled. Since we always must have a thread running we need to check whether
- * we have any usable/useful threads scheduled. If not, then return the idle_thread (a thread that simply waits).
- * Otherwise pop the next thread from the fifo ready threads queue.
+ * Determines the next thread to be scheduled on the current hart. Since we always must have a thread running
+ * we need to check whether we have any usable/useful threads scheduled. If our own ready queue has drained,
+ * we attempt to steal a thread from a sibling hart's queue before falling back to the hart's idle_thread
+ * (a thread that simply waits).
+ *
+ * Note that this function must be called with interrupts disabled (see hart_current).
  *
  * @returns:
  *
  */
 static thread_t* scheduler_pop(void) {
-    return list_size(&ready_threads) == 0
-        ? idle_thread
-        : LIST_VALUE(thread_t, list_node, list_pop_head(&ready_threads));
+    hart_t* h = hart_current();
+    thread_t* t = null;
+
+    intr_state_t state = spinlock_acquire(&h->ready_lock);
+    if (h->ready_bitmap != 0) {
+        t = ready_queue_remove(h, highest_ready_priority(h), false);
+    }
+    spinlock_release(&h->ready_lock, state);
+
+    // Our queue has drained; steal from a sibling before idling.
+    if (t == null) t = scheduler_steal(h);
+
+    return t == null ? h->idle_thread : t;
 }
 
 /**
@@ -358,18 +772,29 @@ static thread_t* scheduler_pop(void) {
  * If the thread reaches the end of it's time slice, it's preempted.
  *
  */
-void scheduler_tick(void) {
+void scheduler_tick(uint64_t elapsed) {
     thread_t* t = thread_current();
 
-    uint64_t ts = timer_ticks();
-    if (ts % 100000 == 0) {
-        info("%d ticks\n", ts);
-    }
-
-    // Enforce preemption
-    if (--t->scheduler_info.time == 0) {
-        // info("preempting thread %d...\n", t->tid);
+    // Sample the hart's load (ready queue depth plus the running thread; idle
+    // doesn't count) into the decayed average, with 1/8 weight per sample. Under
+    // the tickless timer these samples arrive at deadlines rather than at a fixed
+    // rate — coarse, but plenty for answering "is this hart drowning".
+    hart_t* h = hart_current();
+    uint64_t depth = h->ready_count + (t != h->idle_thread ? 1 : 0);
+    h->loadavg += ((int64_t)(depth << LOADAVG_SHIFT) - (int64_t)h->loadavg) >> 3;
+
+    // Enforce preemption. Under the tickless timer interrupts arrive at deadlines
+    // rather than at a fixed rate, so the slice is charged with the [elapsed] ticks
+    // since this hart's accounting was last settled. A thread that burns it's entire
+    // time slice is demoted one priority level (see the MLFQ description above).
+    if (elapsed >= t->scheduler_info.time) {
+        // Recharge here as well as in thread_run: if the yield re-picks this thread
+        // (nothing else is runnable), no dispatch occurs.
+        t->scheduler_info.time = TIME_SLICE;
+        if (t->scheduler_info.priority > PRI_MIN) t->scheduler_info.priority--;
         thread_yield();
+    } else {
+        t->scheduler_info.time -= elapsed;
     }
 }
 
@@ -380,8 +805,36 @@ void __schedule_tail(thread_t* prev) {
     assert(is_thread(cur));
     assert(cur != prev);
 
+    // Finish a hand-off block (see thread_block_release): [prev]'s context is now
+    // saved, so it's safe to let a remote waker pop — and run — it.
+    hart_t* h = hart_current();
+    if (h->block_release != null) {
+        spinlock_release(h->block_release, INTR_OFF);
+        h->block_release = null;
+    }
+
     thread_run(cur);
 
+    // Lazy FPU: resume with the FP unit off unless the hart's register file already
+    // holds [cur]'s state, so the first FP instruction of any other thread faults
+    // into fpu_handle_fault. Most threads never touch FP and never pay for it.
+    uint64_t sstatus = r_sstatus() & ~SSTATUS_FS_MASK;
+    if (cur == hart_current()->fpu_owner) sstatus |= SSTATUS_FS_CLEAN;
+    w_sstatus(sstatus);
+
+    // Switch address space if [cur] belongs to a different process. Every page
+    // table shares the kernel's mappings (see uvm_create), so switches between
+    // kernel threads never touch satp and never flush the TLB.
+    pagetable_t pt = cur->proc->pagetable;
+    if (pt != null && r_satp() != SATP(pt)) {
+        w_satp(SATP(pt));
+        sfence_vma();
+    }
+
+    // A fresh thread (and hence a fresh slice) is on the hart; reprogram the
+    // comparator with it's preemption deadline.
+    timer_rearm();
+
     if (prev != null && prev->status == THREAD_DEAD) {
         free_thread(prev);
     }
@@ -401,6 +854,10 @@ static void schedule(void) {
     assert(is_thread(cur));
     assert(cur->status != THREAD_RUNNING);
 
+    // Settle [cur]'s accumulated runtime: it's leaving the hart (thread_run
+    // re-stamps last_dispatched at it's next dispatch).
+    cur->scheduler_info.runtime += r_time() - cur->scheduler_info.last_dispatched;
+
     // Determine the next thread to be scheduled.
     thread_t* next = scheduler_pop();
     assert(is_thread(next));
@@ -408,11 +865,139 @@ static void schedule(void) {
     // If a context switch is required, execute it.
     context_t* prev = null;
     if (cur != next) {
+        // Lazy FPU, eager save: if [cur] dirtied the FP register file, dump it to
+        // [cur]'s fpu_state now — [cur] may well be stolen by a sibling hart, and
+        // memory is the only place it can pick it's FP state up from.
+        uint64_t sstatus = r_sstatus();
+        if ((sstatus & SSTATUS_FS_MASK) == SSTATUS_FS_DIRTY) {
+            fpu_save_state(cur->fpu_state);
+            w_sstatus((sstatus & ~SSTATUS_FS_MASK) | SSTATUS_FS_CLEAN);
+        }
+
+        perf_count(PERF_CTX_SWITCH);
+        trace("sched:switch", next->tid);
+
         prev = switch_contexts(&cur->ctx, &next->ctx);
     }
     __schedule_tail((thread_t*)PAGE_ROUND_DOWN((uint64_t)prev));
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// THREAD STATISTICS                                                                                                  //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The accounting above (runtime, wakeup-to-dispatch latency, queue depth, load) is all maintained on the
+// scheduler's existing paths; this section is just how you read it. All times are mtime cycles
+// (TIMER_INTERVAL of them to a tick).
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Procedure:   thread_stats_foreach
+ * ---------------------------------
+ * Calls [fn] on every live thread. The walk holds the registry lock (so threads
+ * can't be created or reaped mid-walk) — keep [fn] short and don't block in it.
+ *
+ * @fn:     The callback to invoke per thread.
+ * @aux:    An auxiliary argument passed through to [fn].
+ *
+ */
+void thread_stats_foreach(void (*fn)(thread_t* t, void* aux), void* aux) {
+    intr_state_t state = spinlock_acquire(&all_threads_lock);
+
+    list_node_t* it;
+    for (it = list_head(&all_threads); it != &all_threads.nil; it = it->next) {
+        fn(LIST_VALUE(thread_t, all_node, it), aux);
+    }
+
+    spinlock_release(&all_threads_lock, state);
+}
+
+// Keep in sync with thread_state_t in thread.h.
+static const char* thread_state_names[] = {
+    [THREAD_NEW]        = "new",
+    [THREAD_READY]      = "ready",
+    [THREAD_RUNNING]    = "running",
+    [THREAD_BLOCKED]    = "blocked",
+    [THREAD_DEAD]       = "dead",
+};
+
+static void __thread_stats_dump(thread_t* t, UNUSED void* aux) {
+    scheduler_info_t* si = &t->scheduler_info;
+    uint64_t avg_wait = si->dispatches == 0 ? 0 : si->wait_total / si->dispatches;
+
+    printf(
+            "ps:   %d\t%s\t%s\tpri %d\truntime %d\twait avg/worst %d/%d over %d dispatches\n",
+            t->tid, t->name, thread_state_names[t->status], si->priority,
+            si->runtime, avg_wait, si->wait_worst, si->dispatches
+    );
+}
+
+/*
+ * Procedure:   thread_stats_dump
+ * ------------------------------
+ * The ps-alike: dumps each hart's ready queue depth and load average, then a line
+ * per live thread over the uart. A running thread's runtime is settled at switch-out,
+ * so it's figure excludes the tail of it's current stint on the hart.
+ *
+ */
+void thread_stats_dump(void) {
+    printf("ps: hart\tready\tload (x100)\n");
+    for (uint64_t i = 0; i < NUM_HART; i++) {
+        hart_t* h = &harts[i];
+        printf("ps:   %d\t%d\t%d\n", i, h->ready_count, (h->loadavg * 100) >> LOADAVG_SHIFT);
+    }
+
+    printf("ps: tid\tname\tstatus\n");
+    thread_stats_foreach(__thread_stats_dump, null);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// LAZY FPU SWITCHING                                                                                                 //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The trap frame and switch_contexts handle only integer state; the FP register file is
+// switched lazily. Every thread is dispatched with sstatus.FS off, so it's first FP
+// instruction raises an illegal-instruction exception, which lands here. The register
+// file is then loaded from the faulting thread's fpu_state and FS is enabled for it.
+//
+// The other half is in schedule(): a thread that *dirtied* the register file has it's
+// state dumped back to memory at switch-out (eager save, lazy restore), so a thread's
+// fpu_state is always current whenever the thread isn't running — which is what makes
+// work stealing safe. [hart->fpu_owner] records whose state the hart's register file
+// holds, letting the owner skip the reload when it's rescheduled on the same hart.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Procedure:   fpu_handle_fault
+ * -----------------------------
+ * This procedure handles the illegal-instruction exception raised by the first FP
+ * instruction a thread executes while sstatus.FS is off: it loads the thread's FP
+ * state (zeroed at creation, so first use sees a clean register file) and re-enables
+ * FS in the trap frame so the faulting instruction is retried successfully.
+ *
+ * Called by s_exc_handler; interrupts are disabled.
+ *
+ * @trap_frame_t* tf:       The faulting thread's trap frame.
+ *
+ */
+void fpu_handle_fault(trap_frame_t* tf) {
+    assert(intr_get_state() == INTR_OFF);
+
+    hart_t* h = hart_current();
+    thread_t* cur = thread_current();
+
+    // Enable the FP unit for our own fld/fsd instructions.
+    w_sstatus((r_sstatus() & ~SSTATUS_FS_MASK) | SSTATUS_FS_CLEAN);
+
+    if (h->fpu_owner != cur) {
+        // No need to save the old owner's registers: they were dumped to it's
+        // fpu_state when it was switched out (see schedule).
+        fpu_restore_state(cur->fpu_state);
+        h->fpu_owner = cur;
+    }
+
+    // Retry the faulting instruction with the FP unit on.
+    tf->status = (tf->status & ~SSTATUS_FS_MASK) | SSTATUS_FS_CLEAN;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // PROCESSES                                                                                                          //
@@ -455,7 +1040,7 @@ static void proc_deregister_thread(thread_t* t) {
 
 //    lock_acquire(&p->lock);
     if (--p->thread_count == 0 && p != &kernel_proc) {
-        free_page(p->pagetable);
+        uvm_destroy(p->pagetable);
         free(p);
     }
 //    lock_release(&p->lock);
@@ -484,11 +1069,12 @@ static void kthread(void (*function)(void*), void* arg) {
 }
 
 
-static thread_t* __kthread_create(char* name, void (*function)(void*), void* arg) {
+static thread_t* __kthread_create(char* name, void (*function)(void*), void* arg, uint8_t priority) {
     assert(function != null);
 
-    thread_t* t = alloc_thread(name, &kernel_proc);
+    thread_t* t = alloc_thread(name, &kernel_proc, priority);
     t->tid = allocate_tid();
+    tid_index_insert(t);
 
     // Store the trap frame on the kernel stack of the thread :)
     uint64_t sp = (uint64_t)t + PAGE_SIZE;
@@ -522,8 +1108,8 @@ static thread_t* __kthread_create(char* name, void (*function)(void*), void* arg
     return t;
 }
 
-tid_t kthread_create(char* name, void (*function)(void*), void* arg) {
-    thread_t* t = __kthread_create(name, function, arg);
+tid_t kthread_create_with_priority(char* name, void (*function)(void*), void* arg, uint8_t priority) {
+    thread_t* t = __kthread_create(name, function, arg, priority);
     if (t == null) return -1;
 
     t->status = THREAD_BLOCKED;
@@ -534,6 +1120,82 @@ tid_t kthread_create(char* name, void (*function)(void*), void* arg) {
     return tid;
 }
 
+tid_t kthread_create(char* name, void (*function)(void*), void* arg) {
+    return kthread_create_with_priority(name, function, arg, PRI_DEFAULT);
+}
+
+/*
+ * Function:    uprocess_create
+ * ----------------------------
+ * Creates a user process: a fresh address space (sharing the kernel mappings, see
+ * uvm_create), the user code copied into pages mapped at USER_TEXT_START, a page of
+ * user stack below USER_STACK_TOP, and a single thread to run it.
+ *
+ * The thread is launched the same way as a kernel thread — via a fabricated trap
+ * frame that s_ret_trap "returns" through — except the frame carries SPP = U, so
+ * the sret drops into user mode (and s_ret_trap arms sscratch with the kernel
+ * stack top for the thread's first trap back in).
+ *
+ * @char* name:             The name of the process (and it's initial thread).
+ * @const void* code:       The user program image, copied into the new address space.
+ * @size_t size:            The size of the image in bytes.
+ *
+ * @returns:                the tid of the process's initial thread.
+ *
+ */
+tid_t uprocess_create(char* name, const void* code, size_t size) {
+    proc_t* p = malloc(sizeof(proc_t));
+    assert(p != null);
+
+    strncpy(p->name, name, 32);
+    p->thread_count = 0;
+    p->pagetable = uvm_create();
+
+    // Copy the program image into fresh pages mapped at USER_TEXT_START.
+    for (size_t offset = 0; offset < size; offset += PAGE_SIZE) {
+        void* page = alloc_page_zeroed();
+        size_t n = size - offset < PAGE_SIZE ? size - offset : PAGE_SIZE;
+        memcpy(page, (const uint8_t*)code + offset, n);
+        map(p->pagetable, USER_TEXT_START + offset, (paddr_t)page, PAGE_SIZE,
+                PTE_R | PTE_W | PTE_X | PTE_U);
+    }
+
+    // The user stack: only the top page of the USER_STACK_PAGES range is
+    // materialized eagerly — the rest appear on demand in the page-fault path
+    // (see uvm_handle_stack_fault), with a guard page at the bottom of the range.
+    map(p->pagetable, USER_STACK_TOP - PAGE_SIZE, (paddr_t)alloc_page_zeroed(), PAGE_SIZE,
+            PTE_R | PTE_W | PTE_U);
+
+    thread_t* t = alloc_thread(name, p, PRI_DEFAULT);
+    t->tid = allocate_tid();
+    tid_index_insert(t);
+
+    uint64_t sp = (uint64_t)t + PAGE_SIZE;
+
+    trap_frame_t* tf = (trap_frame_t*)(sp -= sizeof(trap_frame_t));
+    bzero(tf, sizeof(trap_frame_t));
+
+    tf->epc = USER_TEXT_START;
+    tf->regs[2] = USER_STACK_TOP;
+
+    // SPP = U (drop privilege on sret), SPIE (user code runs with interrupts
+    // enabled) and the FP unit off (lazy FPU, as for any fresh thread).
+    tf->status = (r_sstatus() | SSTATUS_SPIE)
+            & ~(SSTATUS_SPP_MASK | SSTATUS_SIE_MASK | SSTATUS_FS_MASK);
+
+    context_t* ctx = (context_t*)(sp -= sizeof(context_t));
+    ctx->ra = (uint64_t)__schedule_tail_entry;
+
+    t->ctx = ctx;
+
+    t->status = THREAD_BLOCKED;
+    tid_t tid = t->tid;
+
+    thread_unblock(t);
+
+    return tid;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // THREAD INITIALIZATION                                                                                              //
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -541,12 +1203,15 @@ tid_t kthread_create(char* name, void (*function)(void*), void* arg) {
 static void idle(void* __idle_started) {
     semaphore_t* idle_started = __idle_started;
 
-    idle_thread = thread_current();
+    // Register ourselves as the idle thread of the hart we were created on.
+    // (interrupts must be disabled to use hart_current)
+    intr_state_t state = intr_disable();
+    hart_current()->idle_thread = thread_current();
+    intr_set_state(state);
+
     semaphore_up(idle_started);
 
     for (;;) {
-        info("Idle thread running... Now blocking.\n");
-        info("%d ticks\n", timer_ticks());
         thread_block();
     }
 }
@@ -557,13 +1222,14 @@ void thread_hart_init(void) {
     thread_t* init = __thread_current();
 
     // Initialize the thread.
-    __thread_init(init, "kernel", &kernel_proc);
+    __thread_init(init, "kernel", &kernel_proc, PRI_DEFAULT);
 
     // Set thread to be running and current (required for allocate_tid to work)
     thread_run(init);
 
     // Now allocate tid :)
     init->tid = allocate_tid();
+    tid_index_insert(init);
 }
 
 /*
@@ -587,37 +1253,39 @@ void thread_init(void) {
     scheduler_init();
     proc_init();
 
-    lock_init(&tid_lock);
+    // Initialize the global thread registry and the tid index.
+    spinlock_init(&all_threads_lock);
+    list_init(&all_threads);
+
+    spinlock_init(&tid_index_lock);
+    htable_init(&tid_index, tid_index_key, tid_index_hash);
+
+    // Initialize the dead-thread recycling pool.
+    list_init(&thread_pool);
+    thread_pool_size = 0;
 }
 
 void thread_vm_init(void) {
     proc_vm_init();
 }
 
-void th_f1(void* data) {
-    info("Thread %d started...\n", thread_tid());
-    info("%d ticks\n", timer_ticks());
-}
-
-
+/*
+ * Procedure:   scheduler_start
+ * ----------------------------
+ * This procedure starts preemptive thread scheduling on the calling hart. Each hart has it's own
+ * dedicated idle thread (scheduled whenever the hart's ready queue is empty), so each hart
+ * must call this procedure once during it's initialization.
+ *
+ */
 void scheduler_start(void) {
     semaphore_t idle_started;
     semaphore_init(&idle_started, 0);
 
-
-
-    kthread_create("idle", idle, &idle_started);
+    // The idle thread runs at PRI_MIN; it must never displace a useful thread.
+    kthread_create_with_priority("idle", idle, &idle_started, PRI_MIN);
 
     // Start preemptive thread scheduling
     intr_enable();
 
     semaphore_down(&idle_started);
-    info("Idle thread executed :)\n");
-
-    tid_t t1 = kthread_create("t1", th_f1, null);
-    info("Thread t1: %d\n", t1);
-
-    tid_t t2 = kthread_create("t2", th_f1, null);
-    info("Thread t2: %d\n", t2);
-
 }
\ No newline at end of file
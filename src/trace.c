@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/8/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        trace.c
+//      Environment: Tiny OS
+//      Description: The tracepoint ring buffers. Only built with -DTRACE (the trace macro in
+//                   trace.h compiles to nothing otherwise, and so does this file).
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifdef TRACE
+
+#include <lib/stdint.h>
+#include <lib/stdio.h>
+
+#include <debug.h>
+#include <param.h>
+#include <riscv.h>
+
+#include <trace.h>
+
+// Each hart has it's own ring, so tracepoints never contend — a record is a
+// hart-local counter bump and three stores.
+static trace_record_t trace_rings[NUM_HART][TRACE_RING_SIZE];
+
+// The number of records ever written by each hart; the slot of the next record is
+// heads[hart] & (TRACE_RING_SIZE - 1).
+static uint64_t trace_heads[NUM_HART];
+
+/*
+ * Procedure:   __trace
+ * --------------------
+ * Writes a record into the current hart's ring (called via the trace macro).
+ *
+ * The slot is reserved (by bumping the head) *before* it's filled, so a tracepoint
+ * hit by an interrupt mid-record writes into the next slot rather than clobbering
+ * this one — no locking, and safe to call from the trap path itself.
+ *
+ * @const char* name:   The tracepoint name. Must be a string literal.
+ * @uint64_t arg:       An arbitrary payload (tid, scause, ...).
+ *
+ */
+void __trace(const char* name, uint64_t arg) {
+    uint64_t hartid = r_hartid();
+    uint64_t slot = trace_heads[hartid]++ & (TRACE_RING_SIZE - 1);
+
+    trace_record_t* r = &trace_rings[hartid][slot];
+    r->cycles = r_cycle();
+    r->arg = arg;
+    r->name = name;
+}
+
+/*
+ * Procedure:   trace_dump
+ * -----------------------
+ * Prints every hart's ring, oldest record first. Intended for post-mortem use
+ * (e.g. from kernel_panic) — the rings keep being written while we print, so a
+ * dump from a live system is only approximately consistent.
+ *
+ */
+void trace_dump(void) {
+    for (uint64_t h = 0; h < NUM_HART; h++) {
+        uint64_t head = trace_heads[h];
+        uint64_t n = head < TRACE_RING_SIZE ? head : TRACE_RING_SIZE;
+
+        printf("trace: hart %d (%d records):\n", h, n);
+        for (uint64_t i = head - n; i < head; i++) {
+            trace_record_t* r = &trace_rings[h][i & (TRACE_RING_SIZE - 1)];
+            printf("trace:   %d %s %d\n", r->cycles, r->name, r->arg);
+        }
+    }
+}
+
+#endif
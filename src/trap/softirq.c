@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        softirq.c
+//      Environment: Tiny OS
+//      Description: The softirq (bottom-half) layer.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <lib/stdint.h>
+#include <lib/stdbool.h>
+#include <lib/stddef.h>
+
+#include <debug.h>
+#include <param.h>
+#include <riscv.h>
+
+#include <trap/interrupt.h>
+#include <trap/softirq.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SOFTIRQS                                                                                                            //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Hard interrupt handlers run between plic_claim and plic_complete with interrupts off,
+// so one slow handler delays every other device *and* the timer. To keep that window
+// bounded, handlers are split in two:
+//
+//  - the hard half does only what the device requires to deassert it's interrupt line
+//    (draining a FIFO, acknowledging a register) and raises a softirq;
+//  - the soft half — waking threads, running protocol work — runs from softirq_run,
+//    which s_trap calls on the way out of every interrupt *with interrupts enabled*.
+//
+// Pending softirqs are hart-local: a softirq raised on a hart runs on that hart. If a
+// nested trap arrives while softirqs are running, it's softirq_run returns immediately
+// (the [in_softirq] flag) and the new pending bits are picked up by the outer drain loop.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static softirq_handler_t handlers[SOFTIRQ_MAX];
+
+static volatile uint32_t pending[NUM_HART];
+static bool in_softirq[NUM_HART];
+
+/*
+ * Procedure:   softirq_register
+ * -----------------------------
+ * This procedure installs [handler] as the soft half for softirq number [n].
+ * Each softirq number may only be registered once.
+ *
+ * @uint8_t n:                      The softirq number. Must satisfy [n < SOFTIRQ_MAX].
+ * @softirq_handler_t handler:      The handler that softirq_run invokes.
+ *
+ */
+void softirq_register(uint8_t n, softirq_handler_t handler) {
+    assert(n < SOFTIRQ_MAX && handler != null);
+    assert(handlers[n] == null);
+
+    handlers[n] = handler;
+}
+
+/*
+ * Procedure:   softirq_raise
+ * --------------------------
+ * This procedure marks softirq [n] pending on the current hart. Intended to be called
+ * from hard interrupt handlers; the soft half then runs from softirq_run before the
+ * hart returns from s_trap.
+ *
+ * @uint8_t n:      The softirq number. Must satisfy [n < SOFTIRQ_MAX].
+ *
+ */
+void softirq_raise(uint8_t n) {
+    assert(n < SOFTIRQ_MAX);
+
+    __sync_fetch_and_or(&pending[r_hartid()], 1u << n);
+}
+
+/*
+ * Procedure:   softirq_run
+ * ------------------------
+ * This procedure drains the current hart's pending softirqs, invoking each registered
+ * handler *with interrupts enabled* — so the timer and other devices are never delayed
+ * by deferred work. Called by s_trap after every interrupt; must be entered with
+ * interrupts disabled (and returns with them disabled).
+ *
+ */
+void softirq_run(void) {
+    assert(intr_get_state() == INTR_OFF);
+
+    uint64_t hartid = r_hartid();
+
+    // A nested trap during the handler loop below re-enters here; let the outer
+    // invocation pick up any bits the nested trap raised.
+    if (in_softirq[hartid]) return;
+    in_softirq[hartid] = true;
+
+    while (pending[hartid] != 0) {
+        uint32_t batch = __sync_lock_test_and_set(&pending[hartid], 0);
+
+        intr_enable();
+        while (batch != 0) {
+            uint8_t n = __builtin_ctz(batch);
+            batch &= batch - 1;
+
+            assert(handlers[n] != null);
+            handlers[n]();
+        }
+        intr_disable();
+    }
+
+    in_softirq[hartid] = false;
+}
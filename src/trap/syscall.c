@@ -0,0 +1,88 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// - Alistair O'Brien - 10/6/2020 - University of Cambridge
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//      File:        syscall.c
+//      Environment: Tiny OS
+//      Description: The syscall dispatcher. User-mode ecalls arrive here via the fast
+//                   syscall path in trap_vec.S, which saves only the caller-saved
+//                   registers — so this is deliberately *not* routed through s_trap and
+//                   the full trap_frame_t machinery that faults and interrupts use.
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <lib/stdint.h>
+
+#include <debug.h>
+#include <perf.h>
+#include <riscv.h>
+#include <trace.h>
+
+#include <dev/uart.h>
+#include <dev/timer.h>
+
+#include <trap/interrupt.h>
+#include <threads/thread.h>
+
+#include <trap/syscall.h>
+
+
+/*
+ * Procedure:   syscall_dispatch
+ * -----------------------------
+ * This procedure dispatches a user-mode environment call. The syscall number is passed
+ * in a7 and the arguments in a0 - a5 (following the standard RISC-V convention); the
+ * return value is written back into the frame's a0 slot, from where the fast path
+ * restores it into the user's a0.
+ *
+ * Called from u_trap_entry with interrupts disabled; the body of a syscall executes
+ * as ordinary preemptible kernel code (a syscall may well block, e.g. SYS_SLEEP).
+ *
+ * @syscall_frame_t* frame:     The fast syscall frame on the thread's kernel stack.
+ *
+ */
+void syscall_dispatch(syscall_frame_t* frame) {
+    // The ecall instruction leaves sepc pointing at itself; step past it so that
+    // sret resumes the user program at the following instruction.
+    frame->epc += 4;
+
+    perf_count(PERF_SYSCALL);
+    trace("syscall", frame->a[7]);
+
+    intr_enable();
+
+    uint64_t ret = 0;
+    switch (frame->a[7]) {
+        case SYS_PUTC:
+            uart_putc((uchar_t)frame->a[0]);
+            break;
+        case SYS_GETPID:
+            ret = thread_tid();
+            break;
+        case SYS_YIELD:
+            thread_yield();
+            break;
+        case SYS_SLEEP:
+            timer_sleep(frame->a[0]);
+            break;
+        case SYS_EXIT:
+            thread_exit(frame->a[0]);
+            break;
+        default:
+            warn("Unknown syscall %d from %s (tid %d).\n", frame->a[7], proc_name(), thread_tid());
+            ret = (uint64_t)-1;
+            break;
+    }
+
+    frame->a[0] = ret;
+
+    intr_disable();
+
+    // Lazy FPU: mirror the check in s_trap. A syscall may well have blocked (and the
+    // thread even migrated via work stealing), so by the time we sret the hart's FP
+    // register file may hold another thread's state — yet the saved sstatus still
+    // records an enabled FS from trap entry. Only the hart's fpu owner may resume
+    // with the FP unit on; anyone else re-faults into fpu_handle_fault on their
+    // next FP instruction.
+    if (thread_current() != hart_current()->fpu_owner) {
+        frame->status &= ~SSTATUS_FS_MASK;
+    }
+}
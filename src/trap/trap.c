@@ -12,9 +12,17 @@
 #include <lib/stdbool.h>
 
 #include <debug.h>
+#include <param.h>
+#include <perf.h>
 #include <riscv.h>
+#include <trace.h>
+
+#include <mm/vmm.h>
 
 #include <trap/interrupt.h>
+#include <trap/softirq.h>
+
+#include <threads/thread.h>
 
 #include <trap/trap.h>
 
@@ -60,9 +68,22 @@ void s_exc_handler(trap_frame_t* tf) {
             // and the address 11 is misaligned.
             panic("Address misaligned. Hart: %d, epc: %p, tval: %#x.\n", r_hartid(), tf->epc, tf->tval);
             break;
-        case EXC_INST_PAGE_FAULT:
-        case EXC_LOAD_PAGE_FAULT:
         case EXC_STORE_PAGE_FAULT:
+            // A store to a copy-on-write page (write-protected, PTE_COW tagged) is
+            // resolved by giving the faulting process a private copy (see vmm.c).
+            if (uvm_handle_cow_fault(tf->tval)) break;
+
+            // An absent page in the user stack range is grown on demand.
+            if (uvm_handle_stack_fault(tf->tval)) break;
+
+            panic("Page fault. Hart: %d, epc: %p, tval: %#x.\n", r_hartid(), tf->epc, tf->tval);
+            break;
+        case EXC_LOAD_PAGE_FAULT:
+            if (uvm_handle_stack_fault(tf->tval)) break;
+
+            panic("Page fault. Hart: %d, epc: %p, tval: %#x.\n", r_hartid(), tf->epc, tf->tval);
+            break;
+        case EXC_INST_PAGE_FAULT:
             // A page fault occurs when a virtual address is dereferenced and it's unmapped
             // in the page table.
             panic("Page fault. Hart: %d, epc: %p, tval: %#x.\n", r_hartid(), tf->epc, tf->tval);
@@ -84,6 +105,16 @@ void s_exc_handler(trap_frame_t* tf) {
             );
             break;
         case EXC_ILLEGAL_INST:
+            // With sstatus.FS off, every FP instruction raises an illegal-instruction
+            // exception — that's the lazy FPU switch trap (see thread.c). We don't
+            // advance sepc: the instruction is retried with the FP unit enabled. (If
+            // the instruction was *genuinely* illegal, it re-traps with FS on and
+            // falls through to the panic below.)
+            if ((tf->status & SSTATUS_FS_MASK) == SSTATUS_FS_OFF) {
+                fpu_handle_fault(tf);
+                break;
+            }
+
             // Illegal instruction executed.
             panic("Illegal instruction. Hart: %d, epc: %p, tval: %#x.\n", r_hartid(), tf->epc, tf->tval);
             break;
@@ -125,8 +156,6 @@ void dump_trap_frame(const trap_frame_t* tf) {
 void trap_init() {
     intr_init();
 
-    // Enable interrupts
-    w_sie(r_sie() | SIE_STIE | SIE_SSIE | SIE_SEIE);
     intr_enable();
 }
 
@@ -135,11 +164,102 @@ void trap_init() {
  * ---------------------------
  * To enable trap handling, we first have to store the address of trap handler for the kernel (s_trap)
  * in the stvec (supervisor trap vector) register using the direct trap mode.
+ * We must also enable the timer, software and external interrupts in this hart's sie register
+ * (the sie register is a per-hart csr, so each hart performs this during it's hart initialization).
  */
 void trap_hart_init() {
     w_stvec(STVEC((uintptr_t)s_trap_vec, STVEC_MODE_DIRECT));
+
+    // sscratch must be zero while the hart executes kernel code: it's how
+    // s_trap_vec tells kernel traps from user traps.
+    w_sscratch(0);
+
+    // Enable interrupts
+    w_sie(r_sie() | SIE_STIE | SIE_SSIE | SIE_SEIE);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TRAP LATENCY ACCOUNTING                                                                                            //
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Every trap is timed with the cycle counter and accounted against it's scause:
+// counts, total and worst-case cycles, plus a log-scale latency histogram (bucket b
+// holds traps that took [2^b, 2^(b+1)) cycles). The stats are per hart, so the
+// accounting is plain increments — no atomics on the trap path. A nested trap (one
+// landing inside softirq_run's interrupts-enabled window) runs to completion before
+// the outer trap resumes, so even same-hart updates never tear. Note that the outer
+// trap's figure then *includes* the nested trap's cycles — which is exactly what a
+// tail-latency investigation wants to see. (A timer trap that preempts likewise
+// accounts the time it's thread spent descheduled, so expect a fat tail on the
+// timer interrupt's histogram — the buckets below it are the honest ones.)
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Causes are indexed exceptions first (0 - 15), then interrupts by code (16 + code).
+#define TRAP_STAT_EXC_CAUSES    (16)
+#define TRAP_STAT_CAUSES        (TRAP_STAT_EXC_CAUSES + 10)
+#define TRAP_STAT_BUCKETS       (16)
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_cycles;
+    uint64_t worst_cycles;
+    uint64_t buckets[TRAP_STAT_BUCKETS];
+} trap_stat_t;
+
+static trap_stat_t trap_stats[NUM_HART][TRAP_STAT_CAUSES];
+
+static void trap_stat_account(uint64_t cause, uint64_t cycles) {
+    size_t index = SCAUSE_EXCEPTION(cause);
+    if (SCAUSE_INTERRUPT(cause)) index += TRAP_STAT_EXC_CAUSES;
+    if (index >= TRAP_STAT_CAUSES) return;
+
+    trap_stat_t* stat = &trap_stats[r_hartid()][index];
+
+    stat->count++;
+    stat->total_cycles += cycles;
+    if (cycles > stat->worst_cycles) stat->worst_cycles = cycles;
+
+    // The log2 bucket, clamped to the last one.
+    size_t bucket = 63 - __builtin_clzl(cycles | 1);
+    if (bucket >= TRAP_STAT_BUCKETS) bucket = TRAP_STAT_BUCKETS - 1;
+    stat->buckets[bucket]++;
 }
 
+/*
+ * Procedure:   trap_stat_dump
+ * ---------------------------
+ * Prints, for every cause that has occurred: the count, mean and worst-case
+ * latency in cycles, and the non-empty histogram buckets — summed across harts.
+ *
+ */
+void trap_stat_dump(void) {
+    for (size_t c = 0; c < TRAP_STAT_CAUSES; c++) {
+        trap_stat_t sum = { 0 };
+
+        for (size_t h = 0; h < NUM_HART; h++) {
+            trap_stat_t* stat = &trap_stats[h][c];
+
+            sum.count += stat->count;
+            sum.total_cycles += stat->total_cycles;
+            if (stat->worst_cycles > sum.worst_cycles) sum.worst_cycles = stat->worst_cycles;
+            for (size_t b = 0; b < TRAP_STAT_BUCKETS; b++) sum.buckets[b] += stat->buckets[b];
+        }
+
+        if (sum.count == 0) continue;
+
+        bool is_interrupt = c >= TRAP_STAT_EXC_CAUSES;
+        info(
+                "trap: %s %d: count %d, mean %d cycles, worst %d cycles.\n",
+                is_interrupt ? "interrupt" : "exception",
+                is_interrupt ? c - TRAP_STAT_EXC_CAUSES : c,
+                sum.count, sum.total_cycles / sum.count, sum.worst_cycles
+        );
+
+        for (size_t b = 0; b < TRAP_STAT_BUCKETS; b++) {
+            if (sum.buckets[b] != 0) info("trap:   < %d cycles: %d\n", 2L << b, sum.buckets[b]);
+        }
+    }
+}
 
 /*
  * Procedure:   s_trap
@@ -148,16 +268,37 @@ void trap_hart_init() {
  */
 void s_trap(trap_frame_t* tf) {
 
+    uint64_t start = r_cycle();
+
     // Determine whether the trap is caused by an external interrupt.
     bool is_interrupt = SCAUSE_INTERRUPT(tf->cause);
 
-    // We must assert that s_trap is only called if the previous privilege is Supervisor.
-    assert((tf->status & SSTATUS_SPP_MASK) != 0);
+    // s_trap handles traps from both the kernel (SPP = S) and user code (SPP = U);
+    // user-mode ecalls never reach here, they take the fast syscall path in
+    // trap_vec.S straight to syscall_dispatch.
+
+    perf_count(is_interrupt ? PERF_TRAP_INTERRUPT : PERF_TRAP_EXCEPTION);
+    trace("trap:enter", tf->cause);
 
     if (is_interrupt) {
         s_intr_handler(tf);
+
+        // Run any deferred (bottom-half) work raised by the hard handler, with
+        // interrupts enabled (see softirq.c).
+        softirq_run();
     } else {
         s_exc_handler(tf);
     }
 
+    // Lazy FPU: a trap frame saved while the thread held the FP unit records an
+    // enabled FS — but by the time the thread resumes (it may have been switched out
+    // and even migrated in between), the hart's register file may hold another
+    // thread's state. Only the hart's fpu owner may resume with the FP unit on.
+    if (thread_current() != hart_current()->fpu_owner) {
+        tf->status &= ~SSTATUS_FS_MASK;
+    }
+
+    trace("trap:exit", tf->cause);
+    trap_stat_account(tf->cause, r_cycle() - start);
+
 }